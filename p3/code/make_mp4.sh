@@ -1,3 +1,7 @@
+# the extension of the written frames, see --frame_format
+# frames can also skip the disk: ./rasterizer --stream=y4m | ffmpeg -i - -vcodec libx264 -crf 23 out.mp4
+FORMAT=${1:-png}
+
 cd animation
 
-ffmpeg -framerate 30 -pattern_type glob -i 'frame_*.png' -vcodec libx264 -crf 23 -preset medium -acodec aac -b:a 192k out.mp4
+ffmpeg -framerate 30 -pattern_type glob -i "frame_*.$FORMAT" -vcodec libx264 -crf 23 -preset medium -acodec aac -b:a 192k out.mp4
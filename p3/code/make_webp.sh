@@ -1,3 +1,6 @@
+# the extension of the written frames, see --frame_format
+FORMAT=${1:-png}
+
 cd animation
 
-ffmpeg -framerate 30 -pattern_type glob -i 'frame_*.png' -c:v libwebp_anim -loop 0 -quality 95 out.webp
+ffmpeg -framerate 30 -pattern_type glob -i "frame_*.$FORMAT" -c:v libwebp_anim -loop 0 -quality 95 out.webp
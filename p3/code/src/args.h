@@ -1,9 +1,13 @@
 #ifndef ARGS_H
 #define ARGS_H
 
+#include <algorithm>
 #include <iostream>
+#include <optional>
+#include <thread>
 
 #include <game.h>
+#include <ui/frame_writer.h>
 
 struct Scenes {
 
@@ -33,6 +37,24 @@ struct Arguments {
     usize width = 720, height = 480;
     Scenes scene = Scenes::Test;
     bool write_frames = false;
+    FrameFormats frame_format = FrameFormats::Png;
+    i32 png_compression = 8;
+    bool png_filter = true;
+    std::optional<StreamFormats> stream{};
+    // - for stdout, otherwise a file or named pipe
+    std::string stream_path = "-";
+    bool cache = true;
+    std::string cache_dir = "../cache";
+    bool async_load = true;
+    f32 lod_error = RenderSettings{}.lod_error;
+    bool occlusion_culling = RenderSettings{}.occlusion_culling;
+    bool depth_prepass = RenderSettings{}.depth_prepass;
+    Tonemaps tonemap = RenderSettings{}.tonemap;
+    Heatmaps heatmap = RenderSettings{}.heatmap;
+    // where the per stage frame times are written once the run ends, as JSON if it ends in .json and CSV otherwise
+    std::string profile_path{};
+    // where a build with ENABLE_TRACE writes what every thread did, for Perfetto or chrome://tracing
+    std::string trace_path = "trace.json";
 
     explicit Arguments(char** argv, int argc) : Arguments(slice<char*>::from_raw(++argv, argc-1)){}
 
@@ -63,40 +85,160 @@ struct Arguments {
                     std::cout << "Invalid scene argument expected a string: " << name << std::endl;
                 }
             }else if (arg.rfind("--write_frames=")==0) {
-                std::string value = arg.substr(1+arg.find_first_of('='));
-                std::cout << value;
-                if (value == "true") {
-                    write_frames = true;
-                } else if (value == "false") {
-                    write_frames = false;
+                parse_flag(arg, write_frames);
+            }else if (arg.rfind("--frame_format=")==0) {
+                std::string name = arg.substr(1+arg.find_first_of('='));
+                if (name == "png") {
+                    frame_format = FrameFormats::Png;
+                } else if (name == "qoi") {
+                    frame_format = FrameFormats::Qoi;
+                } else if (name == "ppm") {
+                    frame_format = FrameFormats::Ppm;
+                } else if (name == "pam") {
+                    frame_format = FrameFormats::Pam;
+                }else {
+                    std::cout << "Invalid frame_format argument expected png|qoi|ppm|pam: " << name << std::endl;
+                }
+            }else if (arg.rfind("--png_compression=")==0) {
+                try {
+                    png_compression = std::stoi(arg.substr(1+arg.find_first_of('=')));
+                }catch (std::exception& e) {
+                    std::cout << "Invalid png_compression argument expected an integer: " << e.what() << std::endl;
+                }
+            }else if (arg.rfind("--png_filter=")==0) {
+                parse_flag(arg, png_filter);
+            }else if (arg.rfind("--stream=")==0) {
+                std::string name = arg.substr(1+arg.find_first_of('='));
+                if (name == "none") {
+                    stream = std::nullopt;
+                } else if (name == "rgba") {
+                    stream = StreamFormats::Rgba;
+                } else if (name == "rgb") {
+                    stream = StreamFormats::Rgb;
+                } else if (name == "y4m") {
+                    stream = StreamFormats::Y4m;
+                }else {
+                    std::cout << "Invalid stream argument expected none|rgba|rgb|y4m: " << name << std::endl;
+                }
+            }else if (arg.rfind("--profile=")==0) {
+                profile_path = arg.substr(1+arg.find_first_of('='));
+            }else if (arg.rfind("--trace=")==0) {
+                trace_path = arg.substr(1+arg.find_first_of('='));
+            }else if (arg.rfind("--stream_path=")==0) {
+                stream_path = arg.substr(1+arg.find_first_of('='));
+            }else if (arg.rfind("--cache=")==0) {
+                parse_flag(arg, cache);
+            }else if (arg.rfind("--cache_dir=")==0) {
+                cache_dir = arg.substr(1+arg.find_first_of('='));
+            }else if (arg.rfind("--async_load=")==0) {
+                parse_flag(arg, async_load);
+            }else if (arg.rfind("--occlusion_culling=")==0) {
+                parse_flag(arg, occlusion_culling);
+            }else if (arg.rfind("--depth_prepass=")==0) {
+                parse_flag(arg, depth_prepass);
+            }else if (arg.rfind("--tonemap=")==0) {
+                std::string name = arg.substr(1+arg.find_first_of('='));
+                if (name == "none") {
+                    tonemap = Tonemaps::None;
+                } else if (name == "reinhard") {
+                    tonemap = Tonemaps::Reinhard;
+                } else if (name == "aces") {
+                    tonemap = Tonemaps::Aces;
                 }else {
-                    std::cout << "Invalid flag, can only be true|t|false|f got: " << value << std::endl;
+                    std::cout << "Invalid tonemap argument expected none|reinhard|aces: " << name << std::endl;
+                }
+            }else if (arg.rfind("--heatmap=")==0) {
+                std::string name = arg.substr(1+arg.find_first_of('='));
+                if (name == "none") {
+                    heatmap = Heatmaps::None;
+                } else if (name == "overdraw") {
+                    heatmap = Heatmaps::Overdraw;
+                } else if (name == "lights") {
+                    heatmap = Heatmaps::Lights;
+                } else if (name == "triangles") {
+                    heatmap = Heatmaps::Triangles;
+                } else if (name == "shading_time") {
+                    heatmap = Heatmaps::ShadingTime;
+                }else {
+                    std::cout << "Invalid heatmap argument expected none|overdraw|lights|triangles|shading_time: " << name << std::endl;
+                }
+            }else if (arg.rfind("--lod_error=")==0) {
+                try {
+                    lod_error = std::stof(arg.substr(1+arg.find_first_of('=')));
+                }catch (std::exception& e) {
+                    std::cout << "Invalid lod_error argument expected a number of pixels: " << e.what() << std::endl;
                 }
             }
         }
     }
 
+    static void parse_flag(ref<std::string> arg, ref_mut<bool> flag) {
+        std::string value = arg.substr(1+arg.find_first_of('='));
+        if (value == "true" || value == "t") {
+            flag = true;
+        } else if (value == "false" || value == "f") {
+            flag = false;
+        }else {
+            std::cout << "Invalid flag, can only be true|t|false|f got: " << value << std::endl;
+        }
+    }
+
     void print() const {
         std::cout <<
             "width: " << width <<
             " height: " << height <<
             " write_frames: " << (write_frames?"true":"false") <<
+            " frame_format: " << frame_format.str() <<
+            " png_compression: " << png_compression <<
+            " png_filter: " << (png_filter?"true":"false") <<
+            " stream: " << (stream?std::string{stream->str()} + " to " + stream_path:"none") <<
+            " cache: " << (cache?cache_dir:"false") <<
+            " async_load: " << (async_load?"true":"false") <<
+            " lod_error: " << lod_error <<
+            " occlusion_culling: " << (occlusion_culling?"true":"false") <<
+            " depth_prepass: " << (depth_prepass?"true":"false") <<
+            " tonemap: " << tonemap.str() <<
+            " heatmap: " << heatmap.str() <<
+            " profile: " << (profile_path.empty()?"none":profile_path) <<
             " scene: " << scene.str() <<
             std::endl;
     }
 
+    [[nodiscard]]
+    ResourceStore make_resource_store() const {
+        const usize loader_threads = async_load ? std::max(1u, std::thread::hardware_concurrency() / 2) : 0;
+        return cache ? ResourceStore{cache_dir, loader_threads} : ResourceStore{loader_threads};
+    }
+
+    [[nodiscard]]
+    RenderSettings make_render_settings() const {
+        RenderSettings settings{};
+        settings.lod_error = lod_error;
+        settings.occlusion_culling = occlusion_culling;
+        settings.depth_prepass = depth_prepass;
+        settings.tonemap = tonemap;
+        settings.heatmap = heatmap;
+        return settings;
+    }
+
     Game* make_game() {
+        Game* game;
         switch (this->scene) {
             case Scenes::Halo:
-                return new Game(FrameBuffer{this->width, this->height});
+                game = new Game(FrameBuffer{this->width, this->height}, make_resource_store());
+                break;
             case Scenes::Brick:
-                return new Game(FrameBuffer{this->width, this->height});
+                game = new Game(FrameBuffer{this->width, this->height}, make_resource_store());
+                break;
             case Scenes::Test:
-                return new Game(FrameBuffer{this->width, this->height});
+                game = new Game(FrameBuffer{this->width, this->height}, make_resource_store());
+                break;
             default:
                 std::cout << "Invalid scene argument passed" << std::endl;
                 exit(-1);
         }
+        game->render_settings = make_render_settings();
+        return game;
     }
 
     static Game* from_args(char **argv, int argc) {
@@ -3,6 +3,9 @@
 #include "renderer/renderer.h"
 #include "resources/resource_store.h"
 #include "renderer/scene.h"
+#include "util/job_system.h"
+#include "util/profiler.h"
+#include "renderer/render_stats.h"
 
 
 class Game;
@@ -24,13 +27,17 @@ public:
 
 class Game {
 public:
-    ResourceStore resource_store{};
+    ResourceStore resource_store;
     Scene scene{};
     FrameBuffer frame_buffer;
+    RenderSettings render_settings{};
+    JobSystem jobs{};
+    Profiler profiler{};
+    RenderStats render_stats{};
     std::vector<System*> systems;
 
 
-    explicit Game(FrameBuffer&& frame_buffer) : frame_buffer(std::move(frame_buffer)) {
+    explicit Game(FrameBuffer&& frame_buffer, ResourceStore&& resource_store) : resource_store(std::move(resource_store)), frame_buffer(std::move(frame_buffer)) {
         add_rotating_lights(4.f);
         // add_bricks();
         // add_halo();
@@ -41,8 +48,21 @@ public:
         // add_light_following_player();
     }
 
+    /**
+     * Adds an empty object to the scene right away and loads the OBJ file into it in the background,
+     * its position, rotation and scale can be set before it has loaded
+     */
+    ObjectId load_object(std::string path) {
+        const auto id = scene.add_object(Object(std::vector<Object>{}));
+        resource_store.spawn(
+            [this, path = std::move(path)]() mutable { return Object::load(std::move(path), resource_store); },
+            [this, id](Object&& object) { scene.set_contents(id, std::move(object)); }
+        );
+        return id;
+    }
+
     void airport() {
-        auto airport = scene.add_object(Object::load("../assets/airport/Sunshine Airport.obj", resource_store));
+        auto airport = load_object("../assets/airport/Sunshine Airport.obj");
         // scene[airport].m_scale.x() = 0.001f;
         // scene[airport].m_scale.y() = 0.001f;
         // scene[airport].m_scale.z() = 0.001f;
@@ -61,7 +81,7 @@ public:
 
     void add_minecraft_world() {
 
-        auto halo = scene.add_object(Object::load("../assets/city/Untitled.obj", resource_store));
+        auto halo = load_object("../assets/city/Untitled.obj");
         scene[halo].m_scale.x() = 1.f;
         scene[halo].m_scale.y() = 1.f;
         scene[halo].m_scale.z() = 1.f;
@@ -107,34 +127,34 @@ public:
     }
 
     void add_halo() {
-        auto halo = scene.add_object(Object::load("../assets/halo/spartan_armour_mkv_-_halo_reach.obj", resource_store));
+        auto halo = load_object("../assets/halo/spartan_armour_mkv_-_halo_reach.obj");
         scene[halo].m_position.z() = 0;
     }
 
     void add_bricks() {
-        const auto brick = scene.add_object(Object::load("../assets/bricks/Mauerrest_C.obj", resource_store));
+        const auto brick = load_object("../assets/bricks/Mauerrest_C.obj");
         scene[brick].m_position.y() -= 10;
 
-        const auto city = scene.add_object(Object::load("../assets/city/full_gameready_city_buildings.obj", resource_store));
+        const auto city = load_object("../assets/city/full_gameready_city_buildings.obj");
         scene[city].m_position.y() -= 10;
     }
 
     void add_cube() {
-        auto cube = scene.add_object(Object::load("../assets/brick/brick.obj", resource_store));
+        auto cube = load_object("../assets/brick/brick.obj");
         systems.push_back(new Lambda([cube](auto game, auto, auto time) {
             game->scene[cube].m_rotation.y() = (f32)time/10.f * M_PIf*2;
         }));
     }
 
-    void update(f32 delta, f64 time) {
+    /**
+     * Runs the systems without publishing loaded resources, so it is safe while an earlier frame is still being shaded
+     */
+    void update_systems(f32 delta, f64 time) {
+        const auto zone = profiler.zone(Profiler::Stage::Update);
         for (auto& system : systems) {
             system->update(this, delta, time);
         }
     }
-
-    void render() {
-        Renderer::render(this->frame_buffer, this->scene, this->resource_store);
-    }
 };
 
 #endif //GAME_H
\ No newline at end of file
@@ -1,6 +1,7 @@
 
 
 #include <args.h>
+#include <util/trace.h>
 
 #ifdef GUI
 #include <ui/gui.h>
@@ -10,10 +11,15 @@
 
 int main(int argc, char** argv) {
     Arguments args(argv, argc);
+    TRACE_THREAD("main");
 
     #ifdef GUI
     run_gui(args);
     #else
     run_tui(args);
     #endif
+
+    if (!TRACE_WRITE(args.trace_path)) {
+        std::cout << "Failed to write trace: " << args.trace_path << std::endl;
+    }
 }
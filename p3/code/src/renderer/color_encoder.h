@@ -0,0 +1,166 @@
+#ifndef COLOR_ENCODER_H
+#define COLOR_ENCODER_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include <renderer/pixel.h>
+#include <renderer/render_settings.h>
+#include <util/types.h>
+
+/**
+ * Turns shaded linear colors into gamma encoded 8 bit RGBA, alpha marks the pixels something was drawn to.
+ *
+ * The gamma curve is read from a table indexed by the top bits of the float, 20 exponents below 1 with 256 steps
+ * each, so dark colors get as many entries as bright ones.
+ */
+class ColorEncoder {
+    static constexpr u32 EXPONENTS = 20;
+    static constexpr u32 MANTISSA_BITS = 8;
+    static constexpr usize LUT_SIZE = EXPONENTS << MANTISSA_BITS;
+    // bits of the smallest value the table covers, 2^-20, which still encodes to 0
+    static constexpr u32 LUT_MIN_BITS = (127 - EXPONENTS) << 23;
+    // bits of the largest float below 1
+    static constexpr u32 LUT_MAX_BITS = 0x3F7FFFFF;
+    static constexpr f32 GAMMA = 2.2f;
+
+    static f32 from_bits(u32 bits) {
+        f32 value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    static u32 to_bits(f32 value) {
+        u32 bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    /**
+     * Entries are 32 bit so the AVX2 path can gather them
+     */
+    static ref<std::array<u32, LUT_SIZE>> lut() {
+        static const auto table = [] {
+            std::array<u32, LUT_SIZE> table{};
+            for (usize i = 1; i < LUT_SIZE; i++) {
+                // the middle of the range of floats sharing this index
+                const auto low = from_bits(LUT_MIN_BITS + (static_cast<u32>(i) << (23 - MANTISSA_BITS)));
+                const auto high = from_bits(LUT_MIN_BITS + (static_cast<u32>(i + 1) << (23 - MANTISSA_BITS)));
+                table[i] = static_cast<u32>(std::lround(std::pow((low + high) / 2, 1.f / GAMMA) * 255));
+            }
+            return table;
+        }();
+        return table;
+    }
+
+    INLINE static f32 tonemap(f32 value, Tonemaps tonemap) {
+        switch (tonemap) {
+            case Tonemaps::None:
+                return value;
+            case Tonemaps::Reinhard:
+                return value / (1 + value);
+            case Tonemaps::Aces:
+                // Narkowicz's fit of the ACES filmic curve
+                return value * (2.51f * value + 0.03f) / (value * (2.43f * value + 0.59f) + 0.14f);
+        }
+        return value;
+    }
+
+    INLINE static u32 channel(f32 value, Tonemaps tonemap, ref<std::array<u32, LUT_SIZE>> table) {
+        const auto clamped = std::min(std::max(from_bits(LUT_MIN_BITS), ColorEncoder::tonemap(value, tonemap)), from_bits(LUT_MAX_BITS));
+        return table[(to_bits(clamped) - LUT_MIN_BITS) >> (23 - MANTISSA_BITS)];
+    }
+
+public:
+    /**
+     * @return the pixel as 8 bit RGBA packed with red in the lowest byte
+     */
+    INLINE static u32 encode(ref<Pixel> pixel, Tonemaps tonemap) {
+        const auto& table = lut();
+        const u32 alpha = pixel.normal.magnitude_squared() != 0 ? 255 : 0;
+        return channel(pixel.diffuse.x(), tonemap, table) |
+            channel(pixel.diffuse.y(), tonemap, table) << 8 |
+            channel(pixel.diffuse.z(), tonemap, table) << 16 |
+            alpha << 24;
+    }
+
+    /**
+     * Encodes count pixels into out, eight at a time with AVX2
+     */
+    static void encode(ptr<Pixel> pixels, usize count, Tonemaps tonemap, ptr_mut<u32> out) {
+        const auto& table = lut();
+        usize i = 0;
+
+#ifdef __AVX2__
+        const auto low = _mm256_set1_ps(from_bits(LUT_MIN_BITS));
+        const auto high = _mm256_set1_ps(from_bits(LUT_MAX_BITS));
+        const auto one = _mm256_set1_ps(1.f);
+        const auto min_bits = _mm256_set1_epi32(static_cast<i32>(LUT_MIN_BITS));
+        const auto encode_channel = [&](__m256 value) {
+            switch (tonemap) {
+                case Tonemaps::None:
+                    break;
+                case Tonemaps::Reinhard:
+                    value = _mm256_div_ps(value, _mm256_add_ps(one, value));
+                    break;
+                case Tonemaps::Aces: {
+                    const auto numerator = _mm256_mul_ps(value, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(2.51f), value), _mm256_set1_ps(0.03f)));
+                    const auto denominator = _mm256_add_ps(_mm256_mul_ps(value, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(2.43f), value), _mm256_set1_ps(0.59f))), _mm256_set1_ps(0.14f));
+                    value = _mm256_div_ps(numerator, denominator);
+                } break;
+            }
+            const auto clamped = _mm256_min_ps(_mm256_max_ps(value, low), high);
+            const auto index = _mm256_srli_epi32(_mm256_sub_epi32(_mm256_castps_si256(clamped), min_bits), 23 - MANTISSA_BITS);
+            return _mm256_i32gather_epi32(reinterpret_cast<const int*>(table.data()), index, 4);
+        };
+
+        for (; i + 8 <= count; i += 8) {
+            alignas(32) f32 r[8], g[8], b[8];
+            alignas(32) u32 alpha[8];
+            for (usize j = 0; j < 8; j++) {
+                const auto& pixel = pixels[i + j];
+                r[j] = pixel.diffuse.x();
+                g[j] = pixel.diffuse.y();
+                b[j] = pixel.diffuse.z();
+                alpha[j] = pixel.normal.magnitude_squared() != 0 ? 255u << 24 : 0;
+            }
+            auto packed = encode_channel(_mm256_load_ps(r));
+            packed = _mm256_or_si256(packed, _mm256_slli_epi32(encode_channel(_mm256_load_ps(g)), 8));
+            packed = _mm256_or_si256(packed, _mm256_slli_epi32(encode_channel(_mm256_load_ps(b)), 16));
+            packed = _mm256_or_si256(packed, _mm256_load_si256(reinterpret_cast<const __m256i*>(alpha)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+        }
+#endif
+
+        for (; i < count; i++) {
+            out[i] = encode(pixels[i], tonemap);
+        }
+    }
+
+    /**
+     * @param t from 0 to 1, going from black over blue, green and yellow to red
+     * @return the color as 8 bit RGBA like encode
+     */
+    static u32 heat(f32 t) {
+        static constexpr std::array<std::array<f32, 3>, 5> STOPS{{
+            {0, 0, 0}, {0, 0, 1}, {0, 1, 0}, {1, 1, 0}, {1, 0, 0},
+        }};
+        const auto position = std::clamp(t, 0.f, 1.f) * (STOPS.size() - 1);
+        const auto stop = std::min(static_cast<usize>(position), STOPS.size() - 2);
+        const auto fraction = position - static_cast<f32>(stop);
+        u32 color = 255u << 24;
+        for (usize c = 0; c < 3; c++) {
+            const auto value = STOPS[stop][c] + (STOPS[stop + 1][c] - STOPS[stop][c]) * fraction;
+            color |= static_cast<u32>(std::lround(value * 255)) << (c * 8);
+        }
+        return color;
+    }
+};
+
+#endif //COLOR_ENCODER_H
@@ -0,0 +1,59 @@
+#ifndef DEPTH_BUFFER_H
+#define DEPTH_BUFFER_H
+
+#include <atomic>
+#include <vector>
+
+#include <util/types.h>
+#include <util/vec_math.h>
+
+/**
+ * Only the depth of every pixel, packed tightly so a depth-only pass touches a fraction of the memory a full
+ * frame buffer would. Depths use the same encoding and clear value as Pixel::depth.
+ */
+class DepthBuffer {
+    static constexpr u32 CLEAR_DEPTH = 0xFFFFFFFE;
+
+    usize m_width;
+    usize m_height;
+    std::vector<u32> m_depth;
+
+public:
+    DepthBuffer(usize width, usize height) : m_width(width), m_height(height), m_depth(width * height, CLEAR_DEPTH) {}
+
+    [[nodiscard]]
+    u32 operator[](Vector2<usize> xy) const {
+        return m_depth[xy[0] + xy[1] * m_width];
+    }
+
+    /**
+     * @return true if depth is farther than the stored depth of a pixel by more than bias
+     */
+    [[nodiscard]]
+    INLINE bool behind(Vector2<usize> xy, u32 depth, u32 bias) const {
+        const auto stored = (*this)[xy];
+        return depth > stored && depth - stored > bias;
+    }
+
+    /**
+     * Lowers the depth of a pixel to depth if it is nearer than what is stored
+     */
+    INLINE void set_smaller(Vector2<usize> xy, u32 depth) {
+        auto& stored = m_depth[xy[0] + xy[1] * m_width];
+        auto ptr = (std::atomic<u32>*)(&stored);
+        auto current = ptr->load(std::memory_order_relaxed);
+        while (depth < current && !ptr->compare_exchange_weak(current, depth, std::memory_order_relaxed)) {}
+    }
+
+    [[nodiscard]]
+    usize width() const {
+        return m_width;
+    }
+
+    [[nodiscard]]
+    usize height() const {
+        return m_height;
+    }
+};
+
+#endif //DEPTH_BUFFER_H
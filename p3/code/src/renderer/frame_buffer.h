@@ -1,22 +1,34 @@
 #ifndef FRAME_BUFFER_H
 #define FRAME_BUFFER_H
 
+#include <atomic>
+
 #include <util/vec_math.h>
 #include <util/slice.h>
 #include <renderer/pixel.h>
+#include <renderer/render_settings.h>
 
 struct FrameBuffer {
 private:
     usize m_width;
     usize m_height;
     ptr_mut<Pixel> m_pixels;
+    // 8 bit RGBA of every shaded pixel, written by shading as it goes
+    ptr_mut<u32> m_colors;
+    // work counted for every pixel, only while a heatmap is drawn
+    ptr_mut<u32> m_heat;
+    Heatmaps m_heatmap{Heatmaps::None};
 public:
     FrameBuffer(usize const width, usize const height) : m_width(width), m_height(height) {
         this->m_pixels = new Pixel[width * height];
+        this->m_colors = new u32[width * height]{};
+        this->m_heat = new u32[width * height]{};
     }
 
-    FrameBuffer(FrameBuffer&& other) noexcept : m_width(other.m_width), m_height(other.m_height), m_pixels(other.m_pixels) {
+    FrameBuffer(FrameBuffer&& other) noexcept : m_width(other.m_width), m_height(other.m_height), m_pixels(other.m_pixels), m_colors(other.m_colors), m_heat(other.m_heat), m_heatmap(other.m_heatmap) {
         other.m_pixels = nullptr;
+        other.m_colors = nullptr;
+        other.m_heat = nullptr;
     }
 
     [[nodiscard]]
@@ -64,8 +76,53 @@ public:
         return slice<Pixel>::from_raw(this->m_pixels, this->m_width*this->m_height);
     }
 
+    /**
+     * The output colors of the last shaded frame, red in the lowest byte of each
+     */
+    [[nodiscard]]
+    slice<const u32> colors() const {
+        return slice<const u32>::from_raw(this->m_colors, this->m_width*this->m_height);
+    }
+
+    [[nodiscard]]
+    slice<u32> colors() {
+        return slice<u32>::from_raw(this->m_colors, this->m_width*this->m_height);
+    }
+
+    /**
+     * The heatmap the frame is being drawn with, what heat() counts
+     */
+    [[nodiscard]]
+    Heatmaps heatmap() const {
+        return this->m_heatmap;
+    }
+
+    void set_heatmap(Heatmaps heatmap) {
+        this->m_heatmap = heatmap;
+    }
+
+    [[nodiscard]]
+    slice<const u32> heat() const {
+        return slice<const u32>::from_raw(this->m_heat, this->m_width*this->m_height);
+    }
+
+    [[nodiscard]]
+    slice<u32> heat() {
+        return slice<u32>::from_raw(this->m_heat, this->m_width*this->m_height);
+    }
+
+    /**
+     * Adds to the heat of a pixel other threads may be adding to as well
+     */
+    INLINE void add_heat(Vector2<usize> xy, u32 amount) {
+        auto ptr = (std::atomic<u32>*)(&this->m_heat[xy[0] + xy[1]*this->m_width]);
+        ptr->fetch_add(amount, std::memory_order_relaxed);
+    }
+
     ~FrameBuffer() {
         delete[] this->m_pixels;
+        delete[] this->m_colors;
+        delete[] this->m_heat;
     }
 };
 
@@ -0,0 +1,88 @@
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include <array>
+#include <utility>
+
+#include <renderer/frame_buffer.h>
+#include <renderer/render_settings.h>
+#include <renderer/renderer.h>
+#include <renderer/scene.h>
+#include <resources/resource_store.h>
+#include <util/job_system.h>
+#include <util/profiler.h>
+
+/**
+ * Renders frames in two overlapping stages on two frame buffers. While one frame is shaded and handed to output,
+ * the scene already moves on to the next frame, whose meshes are drawn into the other buffer.
+ *
+ * A frame reaches output one step after it was drawn, so the last frame of a run needs a call to finish.
+ */
+class FramePipeline {
+    FrameBuffer m_second;
+    std::array<ptr_mut<FrameBuffer>, 2> m_frames;
+    // what each frame is shaded with, taken when it was drawn
+    std::array<SceneView, 2> m_views{};
+    std::array<RenderSettings, 2> m_settings{};
+    // the frame the last step drew, it has not been shaded yet when pending is set
+    usize m_drawn{0};
+    bool m_pending{false};
+
+public:
+    /**
+     * @param first one of the two frame buffers, the other one is made with the same size
+     */
+    explicit FramePipeline(ref_mut<FrameBuffer> first) :
+        m_second(first.width(), first.height()), m_frames{&first, &m_second} {}
+
+    FramePipeline(ref<FramePipeline>) = delete;
+    FramePipeline& operator=(ref<FramePipeline>) = delete;
+
+    /**
+     * Shades and outputs the frame drawn by the previous step while the next frame is updated and drawn
+     * @param update moves the scene to the next frame, it runs while the previous frame is shaded so it must not
+     *               change what shading reads, like the textures resources are polled into
+     * @param output gets every frame once it is shaded
+     */
+    template<typename Update, typename Output>
+    void step(
+        ref_mut<Scene> scene, ref<ResourceStore> resources, ref<RenderSettings> settings, ref_mut<JobSystem> jobs,
+        ref_mut<Profiler> profiler, Update&& update, Output&& output
+        ) {
+        const auto next = m_pending ? 1 - m_drawn : m_drawn;
+
+        TaskGraph graph{};
+        if (m_pending) {
+            const auto shaded = graph.add([&] {
+                Renderer::shade(*m_frames[m_drawn], m_views[m_drawn], resources, m_settings[m_drawn], jobs, profiler);
+            });
+            graph.add([&] {
+                output(std::as_const(*m_frames[m_drawn]));
+            }, {shaded});
+        }
+        graph.add([&] {
+            update();
+            scene.update_transforms();
+            Renderer::draw(*m_frames[next], scene, settings, jobs, profiler);
+            m_views[next] = scene.view();
+            m_settings[next] = settings;
+        });
+        graph.run(jobs);
+
+        m_drawn = next;
+        m_pending = true;
+    }
+
+    /**
+     * Shades and outputs the last frame drawn, if it has not been yet
+     */
+    template<typename Output>
+    void finish(ref<ResourceStore> resources, ref_mut<JobSystem> jobs, ref_mut<Profiler> profiler, Output&& output) {
+        if (!m_pending) return;
+        Renderer::shade(*m_frames[m_drawn], m_views[m_drawn], resources, m_settings[m_drawn], jobs, profiler);
+        output(std::as_const(*m_frames[m_drawn]));
+        m_pending = false;
+    }
+};
+
+#endif //FRAME_PIPELINE_H
@@ -0,0 +1,105 @@
+#ifndef OCCLUSION_BUFFER_H
+#define OCCLUSION_BUFFER_H
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <renderer/depth_buffer.h>
+#include <renderer/frame_buffer.h>
+#include <util/job_system.h>
+#include <util/trace.h>
+#include <util/types.h>
+#include <util/vec_math.h>
+
+/**
+ * A low resolution copy of the depth buffer holding the farthest depth of every tile of pixels, built once the
+ * occluders are drawn, either from the frame buffer or from the depth plane of a depth pre-pass. A box whose nearest
+ * point is behind the farthest depth of every tile it covers cannot show.
+ */
+class OcclusionBuffer {
+    static constexpr usize TILE_SIZE = 8;
+
+    usize m_width{0};
+    usize m_height{0};
+    std::vector<u32> m_depth{};
+    Vector2<f32> m_screen{};
+
+public:
+    /**
+     * @param depth_at the depth of the pixel at x, y
+     */
+    template<typename DepthAt>
+    OcclusionBuffer(usize width, usize height, DepthAt depth_at, ref_mut<JobSystem> jobs) :
+        m_width((width + TILE_SIZE - 1) / TILE_SIZE),
+        m_height((height + TILE_SIZE - 1) / TILE_SIZE),
+        m_depth(m_width * m_height, 0),
+        m_screen{static_cast<f32>(width), static_cast<f32>(height)} {
+        jobs.parallel_for(0, m_height, 1, [&](usize first_row, usize end_row) {
+            TRACE_SCOPE_ID("occlusion_tiles", first_row);
+            for (usize ty = first_row; ty < end_row; ty++) {
+                const auto y_end = std::min((ty + 1) * TILE_SIZE, height);
+                for (usize y = ty * TILE_SIZE; y < y_end; y++) {
+                    for (usize x = 0; x < width; x++) {
+                        auto& tile = m_depth[ty * m_width + x / TILE_SIZE];
+                        tile = std::max(tile, depth_at(x, y));
+                    }
+                }
+            }
+        });
+    }
+
+    OcclusionBuffer(ref<FrameBuffer> frame, ref_mut<JobSystem> jobs) :
+        OcclusionBuffer(frame.width(), frame.height(), [&](usize x, usize y) { return frame[{x, y}].depth; }, jobs) {}
+
+    OcclusionBuffer(ref<DepthBuffer> depth, ref_mut<JobSystem> jobs) :
+        OcclusionBuffer(depth.width(), depth.height(), [&](usize x, usize y) { return depth[{x, y}]; }, jobs) {}
+
+    /**
+     * @param mvp takes the box from its own space to clip space
+     * @param depth converts a normalized device depth to the depth stored in pixels
+     * @return true if the box is certainly hidden behind what is already drawn
+     */
+    template<typename Depth>
+    [[nodiscard]]
+    bool occluded(ref<Matrix4<f32>> mvp, ref<Vector3<f32>> min, ref<Vector3<f32>> max, Depth depth) const {
+        f32 min_x = std::numeric_limits<f32>::max(), min_y = min_x, nearest = min_x;
+        f32 max_x = std::numeric_limits<f32>::lowest(), max_y = max_x;
+        for (usize corner = 0; corner < 8; corner++) {
+            const auto cs = mvp * Vector4<f32>{
+                corner & 1 ? max.x() : min.x(),
+                corner & 2 ? max.y() : min.y(),
+                corner & 4 ? max.z() : min.z(),
+                1
+            };
+            // a corner behind the camera projects nowhere sensible, treat the box as visible
+            if (cs.w() <= 0) return false;
+            // the same mapping to pixels the rasterizer uses
+            const auto x = (cs.x() / cs.w() + 0.5f) * m_screen.x();
+            const auto y = (-cs.y() / cs.w() + 0.5f) * m_screen.y();
+            min_x = std::min(min_x, x);
+            max_x = std::max(max_x, x);
+            min_y = std::min(min_y, y);
+            max_y = std::max(max_y, y);
+            nearest = std::min(nearest, cs.z() / cs.w());
+        }
+        if (nearest <= 0) return false;
+        const auto box_depth = depth(nearest);
+
+        // boxes entirely off screen are left to frustum culling
+        if (max_x < 0 || max_y < 0 || min_x >= m_screen.x() || min_y >= m_screen.y()) return false;
+        const auto tile = [](f32 v, f32 screen) {
+            return static_cast<usize>(std::clamp(v, 0.f, screen - 1)) / TILE_SIZE;
+        };
+        const auto tx0 = tile(min_x, m_screen.x()), tx1 = tile(max_x, m_screen.x());
+        const auto ty0 = tile(min_y, m_screen.y()), ty1 = tile(max_y, m_screen.y());
+        for (auto ty = ty0; ty <= ty1; ty++) {
+            for (auto tx = tx0; tx <= tx1; tx++) {
+                if (m_depth[ty * m_width + tx] >= box_depth) return false;
+            }
+        }
+        return true;
+    }
+};
+
+#endif //OCCLUSION_BUFFER_H
@@ -30,23 +30,27 @@ struct Pixel {
 
     u32 depth{0xFFFFFFFE};
 
-    INLINE void set_smaller_depth(Pixel pixel) {
-#ifdef USE_OPEN_MP
+    /**
+     * @return how often it found the pixel locked by another thread
+     */
+    INLINE u32 set_smaller_depth(Pixel pixel) {
+        // pixels are written from several threads, the depth doubles as a lock while one of them copies the rest
         auto ptr = (std::atomic<u32>*)(&this->depth);
         const u32 LOCK_VALUE = 0xFFFFFFFF;
         u32 depth;
-        while ((depth = ptr->exchange(LOCK_VALUE, std::memory_order_acquire)) == 0xFFFFFFFF){}
+        u32 retries = 0;
+        while ((depth = ptr->exchange(LOCK_VALUE, std::memory_order_acquire)) == 0xFFFFFFFF){
+            retries++;
+        }
         if (depth > pixel.depth) {
             depth = pixel.depth;
             std::memcpy(this, &pixel, sizeof(Pixel)-sizeof(pixel.depth));
         }
         ptr->store(depth, std::memory_order_release);
-#else
-        if (pixel.depth < this->depth) *this = pixel;
-#endif
+        return retries;
     }
 
-    INLINE Pixel fragment_shader(ref<Scene> scene, ref<ResourceStore> resources) const;
+    INLINE Pixel fragment_shader(ref<SceneView> scene, ref<ResourceStore> resources) const;
 };
 
 
@@ -105,7 +109,7 @@ INLINE inline Vector3<f32> fresnelSchlick(f32 cosTheta, Vector3<f32> F0)
 }
 
 [[clang::always_inline]]
-INLINE inline Pixel Pixel::fragment_shader(ref<Scene> scene, ref<ResourceStore> resources) const {
+INLINE inline Pixel Pixel::fragment_shader(ref<SceneView> scene, ref<ResourceStore> resources) const {
     auto pixel = *this;
     if (pixel.normal.magnitude_squared() == 0.) return pixel;
 
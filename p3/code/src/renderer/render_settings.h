@@ -0,0 +1,91 @@
+#ifndef RENDER_SETTINGS_H
+#define RENDER_SETTINGS_H
+
+#include <string_view>
+
+#include <util/types.h>
+
+/**
+ * Curves that bring colors brighter than white back into range before they are gamma encoded
+ */
+struct Tonemaps {
+
+    enum Kind {
+        // colors are clipped at white
+        None,
+        Reinhard,
+        Aces,
+    } kind;
+
+    Tonemaps(Kind kind) : kind(kind) {} // NOLINT
+
+    operator Kind() const { return kind; } // NOLINT
+
+    std::string_view str() const { // NOLINT
+        switch (kind) {
+            case None:
+                return "none";
+            case Reinhard:
+                return "reinhard";
+            case Aces:
+                return "aces";
+        }
+        return "none";
+    }
+};
+
+/**
+ * Work done for each pixel, shown in place of its color to find what makes a frame expensive
+ */
+struct Heatmaps {
+
+    enum Kind {
+        None,
+        // fragments that passed the depth test, so were written over whatever was nearer before them
+        Overdraw,
+        // lights the fragment shader evaluated
+        Lights,
+        // triangles rasterized per pixel, averaged over tiles since most are smaller than a pixel
+        Triangles,
+        // time the fragment shader took
+        ShadingTime,
+    } kind;
+
+    Heatmaps(Kind kind) : kind(kind) {} // NOLINT
+
+    operator Kind() const { return kind; } // NOLINT
+
+    std::string_view str() const { // NOLINT
+        switch (kind) {
+            case None:
+                return "none";
+            case Overdraw:
+                return "overdraw";
+            case Lights:
+                return "lights";
+            case Triangles:
+                return "triangles";
+            case ShadingTime:
+                return "shading_time";
+        }
+        return "none";
+    }
+};
+
+/**
+ * Options for how the renderer draws a frame, set from the command line
+ */
+struct RenderSettings {
+    // largest error in pixels a simplified level of detail may put on screen, 0 always draws the full meshes
+    f32 lod_error{1.f};
+    // draw large meshes first and skip meshes and meshlets hidden behind them
+    bool occlusion_culling{true};
+    // rasterize depth alone first, then write the attributes of each pixel once instead of for every nearer fragment
+    bool depth_prepass{false};
+    // applied to shaded colors as they are encoded for output
+    Tonemaps tonemap{Tonemaps::None};
+    // replaces the output colors with how much work each pixel took
+    Heatmaps heatmap{Heatmaps::None};
+};
+
+#endif //RENDER_SETTINGS_H
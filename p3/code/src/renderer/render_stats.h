@@ -0,0 +1,169 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <array>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include <util/types.h>
+
+/**
+ * Counts of the work the renderer does. Every thread adds to its own counters without synchronization, end_frame
+ * sums those of all threads into a sample and starts them over.
+ *
+ * Triangles are counted once per frame, the depth prepass only adds the pixels it tests. Each one submitted is
+ * either culled, dropped at the near plane or rasterized, instances culled as a whole count all of theirs.
+ */
+class RenderStats {
+public:
+    enum class Counter : usize {
+        TrianglesSubmitted,
+        TrianglesBackfaceCulled,
+        TrianglesFrustumCulled,
+        TrianglesOcclusionCulled,
+        TrianglesNearDropped,
+        TrianglesRasterized,
+        // samples covered by a triangle
+        PixelsTested,
+        // covered samples nearer than what the pixel held, which are written unless a nearer one gets there first
+        DepthPasses,
+        LockRetries,
+        FragmentsShaded,
+        LightsEvaluated,
+        Count,
+    };
+
+    static constexpr usize COUNTERS = static_cast<usize>(Counter::Count);
+    static constexpr std::array<std::string_view, COUNTERS> NAMES{
+        "triangles_submitted", "triangles_backface_culled", "triangles_frustum_culled", "triangles_occlusion_culled",
+        "triangles_near_dropped", "triangles_rasterized", "pixels_tested", "depth_passes", "lock_retries",
+        "fragments_shaded", "lights_evaluated",
+    };
+
+    class Counts {
+        std::array<u64, COUNTERS> m_values{};
+
+    public:
+        INLINE u64& operator[](Counter counter) {
+            return m_values[static_cast<usize>(counter)];
+        }
+
+        INLINE u64 operator[](Counter counter) const {
+            return m_values[static_cast<usize>(counter)];
+        }
+
+        Counts& operator+=(ref<Counts> other) {
+            for (usize i = 0; i < COUNTERS; i++) m_values[i] += other.m_values[i];
+            return *this;
+        }
+    };
+
+private:
+    /**
+     * The counters of every thread that rendered, they live as long as the program
+     */
+    struct Registry {
+        std::mutex mutex{};
+        std::vector<std::unique_ptr<Counts>> counts{};
+    };
+
+    static inline thread_local ptr_mut<Counts> t_counts = nullptr;
+
+    static ref_mut<Registry> registry() {
+        static Registry registry{};
+        return registry;
+    }
+
+    Counts m_last{};
+    Counts m_total{};
+    usize m_frames{0};
+
+    /**
+     * Sums and starts over the counters of every thread
+     */
+    static Counts collect() {
+        auto& registry = RenderStats::registry();
+        std::lock_guard lock{registry.mutex};
+        Counts sum{};
+        for (auto& counts : registry.counts) {
+            sum += *counts;
+            *counts = {};
+        }
+        return sum;
+    }
+
+public:
+    RenderStats() = default;
+    RenderStats(ref<RenderStats>) = delete;
+    RenderStats& operator=(ref<RenderStats>) = delete;
+
+    /**
+     * The counters of the calling thread, only it may write to them
+     */
+    INLINE static ref_mut<Counts> local() {
+        if (!t_counts) {
+            auto& registry = RenderStats::registry();
+            std::lock_guard lock{registry.mutex};
+            t_counts = registry.counts.emplace_back(std::make_unique<Counts>()).get();
+        }
+        return *t_counts;
+    }
+
+    /**
+     * Takes the sum of every thread's counters as a sample, no thread may be rendering
+     */
+    void end_frame() {
+        m_last = collect();
+        m_total += m_last;
+        m_frames++;
+    }
+
+    /**
+     * Adds the work done since the last frame, like shading it once the loop is over, to that frame's sample
+     */
+    void finish() {
+        const auto rest = collect();
+        m_last += rest;
+        m_total += rest;
+    }
+
+    [[nodiscard]]
+    usize frames() const {
+        return m_frames;
+    }
+
+    [[nodiscard]]
+    ref<Counts> last() const {
+        return m_last;
+    }
+
+    [[nodiscard]]
+    ref<Counts> total() const {
+        return m_total;
+    }
+
+    /**
+     * The triangles and fragments of the last frame on one line
+     */
+    void print_last(std::ostream& out) const {
+        out << "triangles: " << m_last[Counter::TrianglesRasterized] << '/' << m_last[Counter::TrianglesSubmitted] <<
+            " fragments: " << m_last[Counter::FragmentsShaded] << " depth passes: " << m_last[Counter::DepthPasses];
+    }
+
+    void print(std::ostream& out) const {
+        out << std::left << std::setw(28) << "counter" << std::right << std::setw(16) << "total" << std::setw(16) << "per frame" << '\n';
+        out << std::fixed << std::setprecision(1);
+        for (usize counter = 0; counter < COUNTERS; counter++) {
+            const auto total = m_total[static_cast<Counter>(counter)];
+            out << std::left << std::setw(28) << NAMES[counter] << std::right << std::setw(16) << total <<
+                std::setw(16) << (m_frames == 0 ? 0. : static_cast<f64>(total) / static_cast<f64>(m_frames)) << '\n';
+        }
+        out << std::defaultfloat << std::flush;
+    }
+};
+
+#endif //RENDER_STATS_H
@@ -3,20 +3,102 @@
 
 #include <variant>
 #include <algorithm>
+#include <array>
+#include <chrono>
 #include <cmath>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#ifdef __x86_64__
+#include <x86intrin.h>
+#endif
 
 #include <renderer/scene.h>
 #include <util/vec_math.h>
+#include <renderer/color_encoder.h>
+#include <renderer/depth_buffer.h>
 #include <renderer/frame_buffer.h>
+#include <renderer/occlusion_buffer.h>
+#include <renderer/render_settings.h>
+#include <renderer/render_stats.h>
+#include <renderer/vertex_transform.h>
 #include <resources/obj.h>
+#include <util/job_system.h>
+#include <util/profiler.h>
+#include <util/trace.h>
 
 struct Renderer {
+    // instances whose bounding sphere covers at least this fraction of the screen height are drawn first as occluders
+    static constexpr f32 OCCLUDER_SCREEN_FRACTION = 0.1f;
+
+    // the depth and attribute passes interpolate depth in separately compiled code, fast math lets them round a few ulps apart
+    static constexpr u32 DEPTH_PREPASS_BIAS = 1024;
+
+    enum class Pass {
+        // depth test and attributes together, a nearer fragment overwrites the pixel an earlier one wrote
+        Single,
+        // only the depth of opaque triangles into the depth plane
+        Depth,
+        // attributes of the fragments at the depth the depth pass found, so each pixel is written once
+        Attributes,
+    };
+
+    // rows of pixels cleared or shaded by one job
+    static constexpr usize CLEAR_ROWS = 8;
+    static constexpr usize FRAGMENT_ROWS = 1;
+    // meshlets rasterized by one job
+    static constexpr usize MESHLET_GRAIN = 16;
+
+    // heat at which a heatmap turns red
+    static constexpr f32 HEAT_OVERDRAW_MAX = 8;
+    static constexpr f32 HEAT_LIGHTS_MAX = 8;
+    // triangles per pixel
+    static constexpr f32 HEAT_TRIANGLES_MAX = 1;
+    // shading time goes from black to red on a log scale between these, in heat_clock ticks
+    static constexpr f32 HEAT_SHADING_MIN = 16;
+    static constexpr f32 HEAT_SHADING_MAX = 4096;
+    // side of the squares of pixels triangle density is averaged over
+    static constexpr usize HEAT_TILE = 8;
+
+    /**
+     * Everything before shading, the frame is cleared, the visible meshes are drawn into it and the lights marked on it
+     */
+    static void draw(ref_mut<FrameBuffer> frame, ref<Scene> scene, ref<RenderSettings> settings, ref_mut<JobSystem> jobs, ref_mut<Profiler> profiler) {
+        std::vector<MeshInstance> instances{};
+        frame.set_heatmap(settings.heatmap);
+
+        // finding the visible instances does not touch the frame, so it runs while the frame is cleared
+        TaskGraph graph{};
+        const auto cleared = graph.add_for(frame.height(), CLEAR_ROWS, [&](usize begin, usize end) {
+            const auto zone = profiler.zone(Profiler::Stage::Clear);
+            clear(frame, begin, end);
+        });
+        const auto collected = graph.add([&] {
+            instances = collect_instances(frame, scene, settings);
+        });
+        const auto drawn = graph.add([&] {
+            const auto zone = profiler.zone(Profiler::Stage::RenderScene);
+            render_scene(frame, scene, settings, instances, jobs);
+        }, {cleared, collected});
+        graph.add([&] {
+            const auto zone = profiler.zone(Profiler::Stage::RenderLights);
+            render_lights(frame, scene);
+        }, {drawn});
+        graph.run(jobs);
+    }
 
-    static void render(ref_mut<FrameBuffer> frame, ref<Scene> scene, ref<ResourceStore> resources) {
-        clear(frame);
-        render_scene(frame, scene);
-        render_lights(frame, scene);
-        fragment(frame, scene, resources);
+    /**
+     * Shades a drawn frame and encodes its output colors, which only reads the view so the scene may already be
+     * changing for the next frame
+     */
+    static void shade(ref_mut<FrameBuffer> frame, ref<SceneView> view, ref<ResourceStore> resources, ref<RenderSettings> settings, ref_mut<JobSystem> jobs, ref_mut<Profiler> profiler) {
+        const auto zone = profiler.zone(Profiler::Stage::Fragment);
+        jobs.parallel_for(0, frame.height(), FRAGMENT_ROWS, [&](usize begin, usize end) {
+            TRACE_SCOPE_ID("shade_rows", begin);
+            fragment(frame, view, resources, settings.tonemap, begin, end);
+        });
     }
 
     static void render_lights(ref_mut<FrameBuffer> frame, ref<Scene> scene) {
@@ -58,7 +140,7 @@ struct Renderer {
                     if (x*x + y*y > perspective_size*perspective_size) continue;
                     auto pos = ss.xy() + Vector2<f32>({static_cast<f32>(x), static_cast<f32>(y)});
 
-                    if (pos.x() < 0 || pos.x() > frame.width() || pos.y() < 0 || pos.y() > frame.height()) continue;
+                    if (pos.x() < 0 || pos.x() >= frame.width() || pos.y() < 0 || pos.y() >= frame.height()) continue;
                     Vector2<usize> pixel_cord{static_cast<usize>(pos.x()), static_cast<usize>(pos.y())};
                     if (frame[pixel_cord].depth >= convert_depth(ps.z())) {
                         frame[pixel_cord].diffuse = light.color;
@@ -69,110 +151,465 @@ struct Renderer {
         }
     }
 
-    static void fragment(ref_mut<FrameBuffer> frame, ref<Scene> scene, ref<ResourceStore> resources) {
-        #ifdef USE_OPEN_MP
-        #pragma omp parallel for schedule(static, frame.width())
-        #endif
-        for (usize i = 0; i < frame.size(); i ++) {
-            frame[i] = frame[i].fragment_shader(scene, resources);
+    /**
+     * Shades the rows first_row to end_row and encodes their colors while the pixels are still in cache,
+     * or their heat when the frame is drawn with a heatmap
+     */
+    static void fragment(ref_mut<FrameBuffer> frame, ref<SceneView> view, ref<ResourceStore> resources, Tonemaps tonemap, usize first_row, usize end_row) {
+        const auto first = first_row * frame.width(), end = end_row * frame.width();
+        const auto heatmap = frame.heatmap();
+        auto heat = frame.heat();
+        u64 shaded = 0;
+        for (usize i = first; i < end; i ++) {
+            // the shader leaves pixels nothing was drawn to alone, and evaluates every light for the others
+            const bool drawn = frame[i].normal.magnitude_squared() != 0;
+            shaded += drawn;
+            if (heatmap == Heatmaps::ShadingTime) {
+                const auto start = heat_clock();
+                frame[i] = frame[i].fragment_shader(view, resources);
+                heat[i] = static_cast<u32>(std::min<u64>(heat_clock() - start, std::numeric_limits<u32>::max()));
+                continue;
+            }
+            if (heatmap == Heatmaps::Lights) {
+                heat[i] = drawn ? static_cast<u32>(view.m_lights.size()) : 0;
+            }
+            frame[i] = frame[i].fragment_shader(view, resources);
+        }
+        auto& stats = RenderStats::local();
+        stats[RenderStats::Counter::FragmentsShaded] += shaded;
+        stats[RenderStats::Counter::LightsEvaluated] += shaded * view.m_lights.size();
+        if (heatmap == Heatmaps::None) {
+            ColorEncoder::encode(&frame[first], end - first, tonemap, frame.colors().data() + first);
+        } else {
+            encode_heat(frame, first_row, end_row);
+        }
+    }
+
+    /**
+     * Colors the rows first_row to end_row by their heat, triangles by the density of the tile each pixel is in.
+     * Triangles are counted while drawing, so the rows of other tiles are not written while this reads them.
+     */
+    static void encode_heat(ref_mut<FrameBuffer> frame, usize first_row, usize end_row) {
+        const auto heat = std::as_const(frame).heat();
+        auto colors = frame.colors();
+        const auto width = frame.width();
+        for (usize y = first_row; y < end_row; y++) {
+            const auto tile_first = y / HEAT_TILE * HEAT_TILE;
+            const auto tile_end = std::min(tile_first + HEAT_TILE, frame.height());
+            f32 density = 0;
+            for (usize x = 0; x < width; x++) {
+                const auto i = x + y * width;
+                f32 t = 0;
+                switch (frame.heatmap()) {
+                    case Heatmaps::None:
+                        break;
+                    case Heatmaps::Overdraw:
+                        t = static_cast<f32>(heat[i]) / HEAT_OVERDRAW_MAX;
+                        break;
+                    case Heatmaps::Lights:
+                        t = static_cast<f32>(heat[i]) / HEAT_LIGHTS_MAX;
+                        break;
+                    case Heatmaps::Triangles:
+                        if (x % HEAT_TILE == 0) {
+                            const auto x_end = std::min(x + HEAT_TILE, width);
+                            u64 triangles = 0;
+                            for (auto ty = tile_first; ty < tile_end; ty++) {
+                                for (auto tx = x; tx < x_end; tx++) triangles += heat[tx + ty * width];
+                            }
+                            density = static_cast<f32>(triangles) / static_cast<f32>((x_end - x) * (tile_end - tile_first));
+                        }
+                        t = density / HEAT_TRIANGLES_MAX;
+                        break;
+                    case Heatmaps::ShadingTime:
+                        t = std::log2(std::max(static_cast<f32>(heat[i]), 1.f) / HEAT_SHADING_MIN) / std::log2(HEAT_SHADING_MAX / HEAT_SHADING_MIN);
+                        break;
+                }
+                colors[i] = ColorEncoder::heat(t);
+            }
         }
     }
 
-    static void clear(ref_mut<FrameBuffer> frame) {
-        #ifdef USE_OPEN_MP
-        #pragma omp parallel for
-        #endif
-        for (usize i = 0; i < frame.size(); i ++) {
+    /**
+     * Cycles where the CPU counts them, nanoseconds elsewhere
+     */
+    INLINE static u64 heat_clock() {
+#ifdef __x86_64__
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    /**
+     * Clears the rows first_row to end_row
+     */
+    static void clear(ref_mut<FrameBuffer> frame, usize first_row, usize end_row) {
+        for (usize i = first_row * frame.width(); i < end_row * frame.width(); i ++) {
             frame[i] = Pixel();
         }
+        if (frame.heatmap() != Heatmaps::None) {
+            auto heat = frame.heat();
+            std::fill(heat.data() + first_row * frame.width(), heat.data() + end_row * frame.width(), 0);
+        }
     }
 
-    static void render_scene(ref_mut<FrameBuffer> frame, ref<Scene> scene) {
-        Vector2<f32> screen{static_cast<f32>(frame.width()), static_cast<f32>(frame.height())};
-        auto proj_view = scene.proj_view(screen);
-        auto model = Matrix4<f32>{
-            1, 0, 0, 0,
-            0, 1, 0, 0,
-            0, 0, 1, 0,
-            0, 0, 0, 1
-        };
-        for (auto& object: scene.objects()) {
-            render_object(frame, object, model, proj_view);
+    /**
+     * One placement of a mesh along with what is needed to cull its meshlets in model space
+     */
+    struct MeshInstance {
+        ptr<Mesh> mesh;
+        usize lod;
+        ptr<Material> material;
+        ptr<Matrix4<f32>> model_matrix;
+        ptr<Matrix3<f32>> normal_matrix;
+        Matrix4<f32> mvp;
+        // the camera position in model space
+        Vector3<f32> eye;
+        std::array<Vector4<f32>, 6> planes;
+        // a mirroring model matrix flips which side of a triangle faces the camera
+        bool mirrored;
+        // radius in pixels of the bounding sphere, infinite when the camera is inside it
+        f32 screen_radius;
+    };
+
+    /**
+     * Picks the coarsest level of detail of a mesh whose error, projected at the distance of the mesh, stays under the threshold
+     * @param scale the largest axis scale of the model matrix, bounding how much it stretches the model space errors
+     * @param pixels_per_unit how many pixels one unit in world space covers at distance one
+     */
+    static usize select_lod(ref<Mesh> mesh, f32 scale, f32 distance, f32 pixels_per_unit, f32 threshold) {
+        // the camera is inside the bounds, some part of the mesh may be right in front of it
+        if (threshold <= 0 || distance <= 0) return 0;
+
+        usize lod = 0;
+        while (lod + 1 < mesh.lod_count() && mesh.lod_error(lod + 1) * scale * pixels_per_unit / distance <= threshold) {
+            lod++;
         }
+        return lod;
     }
 
-    static void render_object(ref_mut<FrameBuffer> frame, ref<Object> object, ref<Matrix4<f32>> model_matrix, ref<Matrix4<f32>> proj_view) {
-        if (object.m_kind.index() == 0){
-            render_mesh(frame, std::get<Mesh>(object.m_kind), model_matrix*object.model(), proj_view);
-        }else {
-            for (const auto& child: std::get<std::vector<Object>>(object.m_kind)) {
-                render_object(frame, child, model_matrix*object.model(), proj_view);
+    /**
+     * Every mesh node in view, with its level of detail picked
+     */
+    static std::vector<MeshInstance> collect_instances(ref<FrameBuffer> frame, ref<Scene> scene, ref<RenderSettings> settings) {
+        TRACE_SCOPE("collect_instances");
+        Vector2<f32> screen{static_cast<f32>(frame.width()), static_cast<f32>(frame.height())};
+        auto proj_view = scene.proj_view(screen);
+        const auto& camera = scene.m_camera.position;
+        const auto pixels_per_unit = screen.y() / (2 * std::tan(scene.m_camera.fov / 2));
+
+        std::vector<MeshInstance> instances{};
+        for (const auto& node: scene.nodes()) {
+            if (!node.m_mesh) continue;
+            const auto& model_matrix = node.world();
+            const auto eye = node.world_inverse() * Vector4<f32>{camera.x(), camera.y(), camera.z(), 1};
+
+            // frustum planes in model space, from the rows of the model view projection matrix
+            const auto mvp = proj_view * model_matrix;
+            std::array<Vector4<f32>, 6> planes{};
+            for (usize axis = 0; axis < 3; axis++) {
+                for (usize side = 0; side < 2; side++) {
+                    auto& plane = planes[axis * 2 + side];
+                    for (usize c = 0; c < 4; c++) {
+                        plane[c] = mvp[{3, c}] + (side == 0 ? mvp[{axis, c}] : -mvp[{axis, c}]);
+                    }
+                    plane = plane / plane.xyz().magnitude();
+                }
+            }
+            // whole instances outside the frustum are dropped before any of their meshlets are looked at
+            const auto& bounds = node.m_mesh->m_bounds;
+            if (bounds.empty()) continue;
+            const auto center = bounds.center();
+            const auto radius = (bounds.max - center).magnitude();
+            bool outside = false;
+            for (const auto& plane : planes) {
+                outside |= plane.xyz().dot(center) + plane.w() < -radius;
+            }
+            if (outside) {
+                // no level of detail is picked for instances out of view, they count with the full mesh
+                auto& stats = RenderStats::local();
+                stats[RenderStats::Counter::TrianglesSubmitted] += node.m_mesh->triangles();
+                stats[RenderStats::Counter::TrianglesFrustumCulled] += node.m_mesh->triangles();
+                continue;
             }
+
+            const auto mirrored = Vector3<f32>{model_matrix[{0, 0}], model_matrix[{1, 0}], model_matrix[{2, 0}]}
+                .cross({model_matrix[{0, 1}], model_matrix[{1, 1}], model_matrix[{2, 1}]})
+                .dot({model_matrix[{0, 2}], model_matrix[{1, 2}], model_matrix[{2, 2}]}) < 0;
+
+            f32 scale = 0;
+            for (usize c = 0; c < 3; c++) {
+                scale = std::max(scale, Vector3<f32>{model_matrix[{0, c}], model_matrix[{1, c}], model_matrix[{2, c}]}.magnitude());
+            }
+            const auto world_radius = radius * scale;
+            const auto distance = ((model_matrix * center.extend(1)).xyz() - camera).magnitude() - world_radius;
+            const auto screen_radius = distance > 0 ? world_radius * pixels_per_unit / distance : std::numeric_limits<f32>::infinity();
+
+            const auto lod = select_lod(*node.m_mesh, scale, distance, pixels_per_unit, settings.lod_error);
+            instances.push_back({node.m_mesh.get(), lod, &node.material(), &model_matrix, &node.normal_matrix(), mvp, eye.xyz() / eye.w(), planes, mirrored, screen_radius});
         }
+        return instances;
     }
 
-    static void render_mesh(ref_mut<FrameBuffer> frame, ref<Mesh> mesh, ref<Matrix4<f32>> model_matrix, ref<Matrix4<f32>> proj_view) {
+    static void render_scene(
+        ref_mut<FrameBuffer> frame, ref<Scene> scene, ref<RenderSettings> settings,
+        ref_mut<std::vector<MeshInstance>> instances, ref_mut<JobSystem> jobs
+        ) {
         Vector2<f32> screen{static_cast<f32>(frame.width()), static_cast<f32>(frame.height())};
-        Matrix3<f32> normal_matrix{model_matrix.inverse().transpose()};
-        #ifdef USE_OPEN_MP
-        #pragma omp parallel for schedule(guided)
-        #endif
-        for (const auto& face: mesh.m_faces) {
-            auto ms0 = face.points[0].extend(1);
-            auto ms1 = face.points[1].extend(1);
-            auto ms2 = face.points[2].extend(1);
-
-            auto ws0 = model_matrix * ms0;
-            auto ws1 = model_matrix * ms1;
-            auto ws2 = model_matrix * ms2;
-
-            auto cs0 = proj_view * ws0;
-            auto cs1 = proj_view * ws1;
-            auto cs2 = proj_view * ws2;
+        auto proj_view = scene.proj_view(screen);
 
-            auto norm = (cs1.xyz() - cs0.xyz())
-                .cross(cs2.xyz() - cs0.xyz())
-                .normalize();
-            //   backface culling
-            if (cs0.xyz().dot(norm) <= 0.0 ){
-                continue;
+        if (!settings.depth_prepass) {
+            render_visible<Pass::Single>(frame, instances, screen, proj_view, settings, nullptr, jobs);
+            return;
+        }
+
+        DepthBuffer depth_plane{frame.width(), frame.height()};
+        const auto visible_end = render_visible<Pass::Depth>(frame, instances, screen, proj_view, settings, &depth_plane, jobs);
+        if (!settings.occlusion_culling) {
+            render_instances<Pass::Attributes>(frame, instances.begin(), visible_end, proj_view, nullptr, &depth_plane, jobs);
+            return;
+        }
+        // the finished depth plane hides more than the occluders alone did
+        const OcclusionBuffer occlusion{depth_plane, jobs};
+        const auto attributes_end = std::remove_if(instances.begin(), visible_end, [&](ref<MeshInstance> instance) {
+            return occluded_instance(occlusion, instance);
+        });
+        render_instances<Pass::Attributes>(frame, instances.begin(), attributes_end, proj_view, &occlusion, &depth_plane, jobs);
+    }
+
+    /**
+     * If a whole instance is hidden behind what the occlusion buffer holds, its triangles count as submitted and culled
+     */
+    static bool occluded_instance(ref<OcclusionBuffer> occlusion, ref<MeshInstance> instance) {
+        if (!occlusion.occluded(instance.mvp, instance.mesh->m_bounds.min, instance.mesh->m_bounds.max, convert_depth)) {
+            return false;
+        }
+        const auto triangles = instance.mesh->meshlets(instance.lod).triangle_count();
+        auto& stats = RenderStats::local();
+        stats[RenderStats::Counter::TrianglesSubmitted] += triangles;
+        stats[RenderStats::Counter::TrianglesOcclusionCulled] += triangles;
+        return true;
+    }
+
+    /**
+     * Draws the instances in one pass, with occlusion culling large instances go first and hide what is behind them
+     * @return the end of the instances which were not culled, they are moved to the front
+     */
+    template<Pass PASS>
+    static std::vector<MeshInstance>::iterator render_visible(
+        ref_mut<FrameBuffer> frame, ref_mut<std::vector<MeshInstance>> instances,
+        ref<Vector2<f32>> screen, ref<Matrix4<f32>> proj_view, ref<RenderSettings> settings,
+        ptr_mut<DepthBuffer> depth_plane, ref_mut<JobSystem> jobs
+        ) {
+        if (!settings.occlusion_culling) {
+            render_instances<PASS>(frame, instances.begin(), instances.end(), proj_view, nullptr, depth_plane, jobs);
+            return instances.end();
+        }
+
+        // large instances are drawn first, the depth they leave behind then hides whatever is behind them
+        const auto occluders_end = std::stable_partition(instances.begin(), instances.end(), [&](ref<MeshInstance> instance) {
+            return instance.screen_radius >= screen.y() * OCCLUDER_SCREEN_FRACTION;
+        });
+        render_instances<PASS>(frame, instances.begin(), occluders_end, proj_view, nullptr, depth_plane, jobs);
+        if (occluders_end == instances.begin() || occluders_end == instances.end()) {
+            render_instances<PASS>(frame, occluders_end, instances.end(), proj_view, nullptr, depth_plane, jobs);
+            return instances.end();
+        }
+
+        const auto occlusion = PASS == Pass::Depth ? OcclusionBuffer{*depth_plane, jobs} : OcclusionBuffer{frame, jobs};
+        const auto visible_end = std::remove_if(occluders_end, instances.end(), [&](ref<MeshInstance> instance) {
+            return occluded_instance(occlusion, instance);
+        });
+        render_instances<PASS>(frame, occluders_end, visible_end, proj_view, &occlusion, depth_plane, jobs);
+        return visible_end;
+    }
+
+    /**
+     * Draws a range of instances, instances of the same mesh and level of detail together so their vertex data stays in cache.
+     * The meshlets of every instance are spread over the threads in a single loop, so small meshes share jobs.
+     * @param occlusion when set, meshlets hidden behind what it holds are skipped
+     * @param depth_plane written by the depth pass and tested against by the attribute pass, unused by a single pass
+     */
+    template<Pass PASS>
+    static void render_instances(
+        ref_mut<FrameBuffer> frame,
+        std::vector<MeshInstance>::iterator begin, std::vector<MeshInstance>::iterator end,
+        ref<Matrix4<f32>> proj_view, ptr<OcclusionBuffer> occlusion, ptr_mut<DepthBuffer> depth_plane,
+        ref_mut<JobSystem> jobs
+        ) {
+        std::stable_sort(begin, end, [](ref<MeshInstance> a, ref<MeshInstance> b) {
+            if (a.mesh != b.mesh) return std::less<ptr<Mesh>>{}(a.mesh, b.mesh);
+            return a.lod < b.lod;
+        });
+
+        // instances of one mesh and level of detail, their meshlets are numbered after the ones of earlier batches
+        struct Batch {
+            ptr<MeshInstance> instances;
+            ptr<Meshlets> meshlets;
+            usize first_item;
+            usize end_item;
+        };
+        std::vector<Batch> batches{};
+        usize items = 0;
+        while (begin != end) {
+            auto batch_end = begin + 1;
+            while (batch_end != end && batch_end->mesh == begin->mesh && batch_end->lod == begin->lod) batch_end++;
+            const auto& meshlets = begin->mesh->meshlets(begin->lod);
+            const auto batch_items = static_cast<usize>(batch_end - begin) * meshlets.size();
+            batches.push_back({&*begin, &meshlets, items, items + batch_items});
+            items += batch_items;
+            begin = batch_end;
+        }
+
+        Vector2<f32> screen{static_cast<f32>(frame.width()), static_cast<f32>(frame.height())};
+        jobs.parallel_for(0, items, MESHLET_GRAIN, [&](usize item_begin, usize item_end) {
+            auto batch = std::upper_bound(batches.begin(), batches.end(), item_begin, [](usize item, ref<Batch> b) {
+                return item < b.first_item;
+            }) - 1;
+            // named after the batch, one mesh at one level of detail, the range starts in
+            TRACE_SCOPE_ID("rasterize", batch - batches.begin());
+            for (auto item = item_begin; item < item_end; item++) {
+                while (item >= batch->end_item) batch++;
+                const auto& meshlets = *batch->meshlets;
+                const auto local = item - batch->first_item;
+                const auto& instance = batch->instances[local / meshlets.size()];
+                render_meshlet<PASS>(
+                    frame, *instance.mesh, meshlets, instance, meshlets.meshlets[local % meshlets.size()],
+                    proj_view, screen, occlusion, depth_plane
+                );
             }
+        });
+    }
 
-            if (cs0.z() > cs0.w() && cs1.z() > cs2.w() && cs2.z() > cs2.w()) {
-                continue;
+    /**
+     * Culls and draws one meshlet of an instance
+     */
+    template<Pass PASS>
+    INLINE static void render_meshlet(
+        ref_mut<FrameBuffer> frame, ref<Mesh> mesh, ref<Meshlets> meshlets,
+        ref<MeshInstance> instance, ref<Meshlet> meshlet,
+        ref<Matrix4<f32>> proj_view, ref<Vector2<f32>> screen,
+        ptr<OcclusionBuffer> occlusion, ptr_mut<DepthBuffer> depth_plane
+        ) {
+        const auto& vertices = mesh.m_vertices;
+        const auto& normals = mesh.m_vertices.normals;
+        const auto& uvs = mesh.m_vertices.uvs;
+        const auto& tangents = mesh.m_vertices.tangents;
+        const auto& model_matrix = *instance.model_matrix;
+
+        // which fragments of an alpha tested material show is only known once its texture is read
+        if constexpr (PASS == Pass::Depth) {
+            if (alpha_tested(*instance.material)) {
+                return;
+            }
+        }
+        auto& stats = RenderStats::local();
+        // the attribute pass after a depth pass goes over the same triangles again, only it counts them
+        const auto count = [&](RenderStats::Counter counter, u64 amount) {
+            if constexpr (PASS != Pass::Depth) stats[counter] += amount;
+        };
+        count(RenderStats::Counter::TrianglesSubmitted, meshlet.triangle_count);
+        if (!instance.mirrored && meshlet.back_facing(instance.eye)) {
+            count(RenderStats::Counter::TrianglesBackfaceCulled, meshlet.triangle_count);
+            return;
+        }
+        bool outside = false;
+        for (const auto& plane : instance.planes) {
+            outside |= plane.xyz().dot(meshlet.center) + plane.w() < -meshlet.radius;
+        }
+        if (outside) {
+            count(RenderStats::Counter::TrianglesFrustumCulled, meshlet.triangle_count);
+            return;
+        }
+        if (occlusion) {
+            const Vector3<f32> extent{meshlet.radius, meshlet.radius, meshlet.radius};
+            if (occlusion->occluded(instance.mvp, meshlet.center - extent, meshlet.center + extent, convert_depth)) {
+                count(RenderStats::Counter::TrianglesOcclusionCulled, meshlet.triangle_count);
+                return;
             }
-            if (cs0.x() < -cs0.w() && cs1.x() < -cs1.w() && cs2.x() < -cs2.w()) {
+        }
+
+        // positions are gathered so the meshlet can be transformed with the batched kernel, scratch is owned by the calling thread
+        static thread_local std::array<f32, Meshlet::MAX_VERTICES> x, y, z;
+        static thread_local TransformedVertices transformed{};
+        transformed.resize(Meshlet::MAX_VERTICES);
+
+        const auto* meshlet_vertices = meshlets.vertices.data() + meshlet.vertex_offset;
+        for (usize v = 0; v < meshlet.vertex_count; v++) {
+            x[v] = vertices.x[meshlet_vertices[v]];
+            y[v] = vertices.y[meshlet_vertices[v]];
+            z[v] = vertices.z[meshlet_vertices[v]];
+        }
+        transform_vertices(x.data(), y.data(), z.data(), 0, meshlet.vertex_count, model_matrix, proj_view, transformed);
+
+        const auto* triangles = meshlets.triangles.data() + meshlet.triangle_offset * 3;
+        for (usize t = 0; t < meshlet.triangle_count; t++) {
+            // local indices into the transformed meshlet vertices, global ones into the mesh attributes
+            const auto l0 = triangles[t*3];
+            const auto l1 = triangles[t*3+1];
+            const auto l2 = triangles[t*3+2];
+            const auto i0 = meshlet_vertices[l0];
+            const auto i1 = meshlet_vertices[l1];
+            const auto i2 = meshlet_vertices[l2];
+
+            // every vertex outside the same plane
+            const auto oc0 = transformed.outcodes[l0];
+            const auto oc1 = transformed.outcodes[l1];
+            const auto oc2 = transformed.outcodes[l2];
+            if ((oc0 & oc1 & oc2) != 0) {
+                count(RenderStats::Counter::TrianglesFrustumCulled, 1);
                 continue;
             }
-            if (cs0.x() > cs0.w() && cs1.x() > cs1.w() && cs2.x() > cs2.w()) {
+            // crossing the near plane
+            if (((oc0 | oc1 | oc2) & Outcode::NEAR) != 0) {
+                count(RenderStats::Counter::TrianglesNearDropped, 1);
                 continue;
             }
-            if (cs0.y() < -cs0.w() && cs1.y() < -cs1.w() && cs2.y() < -cs2.w()) {
+
+            const auto cs0 = transformed.clip(l0);
+            const auto cs1 = transformed.clip(l1);
+            const auto cs2 = transformed.clip(l2);
+
+            auto norm = (cs1.xyz() - cs0.xyz())
+                .cross(cs2.xyz() - cs0.xyz());
+            //   backface culling
+            if (cs0.xyz().dot(norm) <= 0.0 ){
+                count(RenderStats::Counter::TrianglesBackfaceCulled, 1);
                 continue;
             }
-            if (cs0.y() > cs0.w() && cs1.y() > cs1.w() && cs2.y() > cs2.w()) {
+            count(RenderStats::Counter::TrianglesRasterized, 1);
+
+            if constexpr (PASS == Pass::Depth) {
+                render_triangle_depth(frame, *depth_plane, cs0, cs1, cs2, screen);
                 continue;
             }
 
-            auto b0 = cs0.z() < -cs0.w();
-            auto b1 = cs1.z() < -cs1.w();
-            auto b2 = cs2.z() < -cs2.w();
+            if (frame.heatmap() == Heatmaps::Triangles) {
+                // counted once its attributes are drawn, at the pixel its center falls on, many are smaller than a pixel and cover none
+                const auto center = screen_space(perspective(cs0 + cs1 + cs2), screen);
+                if (center.x() >= 0 && center.x() < screen.x() && center.y() >= 0 && center.y() < screen.y()) {
+                    frame.add_heat({static_cast<usize>(center.x()), static_cast<usize>(center.y())}, 1);
+                }
+            }
 
-            if (b0||b1||b2)continue;
+            const auto ws0 = transformed.world(l0);
+            const auto ws1 = transformed.world(l1);
+            const auto ws2 = transformed.world(l2);
 
             render_triangle(
                 frame,
-                mesh.m_material,
-                ms0, ms1, ms2,
+                *instance.material,
                 ws0, ws1, ws2,
                 cs0, cs1, cs2,
-                face.normals[0], face.normals[1], face.normals[2],
-                face.uvs[0], face.uvs[1], face.uvs[2],
+                normals[i0], normals[i1], normals[i2],
+                tangents[i0], tangents[i1], tangents[i2],
+                uvs[i0], uvs[i1], uvs[i2],
 
                 model_matrix,
                 proj_view,
-                normal_matrix,
-                screen
+                *instance.normal_matrix,
+                screen,
+                depth_plane
             );
         }
     }
@@ -181,16 +618,17 @@ struct Renderer {
         ref_mut<FrameBuffer> frame,
         ref<Material> material,
 
-        ref<Vector4<f32>> ms0, ref<Vector4<f32>> ms1, ref<Vector4<f32>> ms2,
         ref<Vector4<f32>> ws0, ref<Vector4<f32>> ws1, ref<Vector4<f32>> ws2,
         ref<Vector4<f32>> cs0, ref<Vector4<f32>> cs1, ref<Vector4<f32>> cs2,
         ref<Vector3<f32>> n0, ref<Vector3<f32>> n1, ref<Vector3<f32>> n2,
+        ref<Vector4<f32>> tan0, ref<Vector4<f32>> tan1, ref<Vector4<f32>> tan2,
         ref<Vector2<f32>> uv0, ref<Vector2<f32>> uv1, ref<Vector2<f32>> uv2,
 
         ref<Matrix4<f32>> /* model_matrix */,
         ref<Matrix4<f32>> /* proj_view */,
         ref<Matrix3<f32>> normal_matrix,
-        ref<Vector2<f32>> screen
+        ref<Vector2<f32>> screen,
+        ptr<DepthBuffer> depth_plane
         ) {
         const auto w0 = cs0.w();
         const auto w1 = cs1.w();
@@ -208,6 +646,11 @@ struct Renderer {
         const auto ss1 = screen_space(ps1, screen);
         const auto ss2 = screen_space(ps2, screen);
 
+        // triangles that miss every sample point are dropped before any of the attribute setup
+        if (sample_bounds(ss0, ss1, ss2, frame).empty()) {
+            return;
+        }
+
         const auto n0_c = (normal_matrix * n0) / w0;
         const auto n1_c = (normal_matrix * n1) / w1;
         const auto n2_c = (normal_matrix * n2) / w2;
@@ -216,32 +659,13 @@ struct Renderer {
         Vector3<f32> bt0{}, bt1{}, bt2{};
 
         if (material.normal_map.has_value()) {
-            auto g0 = tangent_bitangent(
-                {ms0.xyz(), ms1.xyz(), ms2.xyz()},
-                {uv0_e, uv1_e, uv2_e},
-                w0,
-                normal_matrix
-            );
-            t0 = g0[0];
-            bt0 = g0[1];
-
-            auto g1 = tangent_bitangent(
-                {ms1.xyz(), ms2.xyz(), ms0.xyz()},
-                {uv1_e, uv2_e, uv0_e},
-                w1,
-                normal_matrix
-            );
-            t1 = g1[0];
-            bt1 = g1[1];
-
-            auto g2 = tangent_bitangent(
-                {ms2.xyz(), ms0.xyz(), ms1.xyz()},
-                {uv2_e, uv0_e, uv1_e},
-                w2,
-                normal_matrix
-            );
-            t2 = g2[0];
-            bt2 = g2[1];
+            t0 = (normal_matrix * tan0.xyz()) / w0;
+            t1 = (normal_matrix * tan1.xyz()) / w1;
+            t2 = (normal_matrix * tan2.xyz()) / w2;
+            // the bitangent is rebuilt from the normal and the tangent, w holds which way it points
+            bt0 = (normal_matrix * (n0.cross(tan0.xyz()) * tan0.w())) / w0;
+            bt1 = (normal_matrix * (n1.cross(tan1.xyz()) * tan1.w())) / w1;
+            bt2 = (normal_matrix * (n2.cross(tan2.xyz()) * tan2.w())) / w2;
         }
 
         uv0_e = uv0_e / w0;
@@ -269,9 +693,10 @@ struct Renderer {
             normal_map = material.normal_map.value()->get_id();
         }
 
-        if (material.diffuse_map.has_value() && material.diffuse_map->get()->transparent()) {
+        if (alpha_tested(material)) {
             draw_triangle_filled_textured(
                frame,
+               depth_plane,
                ss0, ss1, ss2,
                 ws0.xyz()/w0, ws1.xyz()/w1, ws2.xyz()/w2,
                 n0_c, n1_c, n2_c,
@@ -289,6 +714,7 @@ struct Renderer {
         }else {
             draw_triangle_filled_textured_deferred(
                frame,
+               depth_plane,
                ss0, ss1, ss2,
                 ws0.xyz()/w0, ws1.xyz()/w1, ws2.xyz()/w2,
                n0_c, n1_c, n2_c,
@@ -307,6 +733,26 @@ struct Renderer {
         }
     }
 
+    /**
+     * Only the depth of a triangle, none of its attributes are set up
+     */
+    INLINE static void render_triangle_depth(
+        ref_mut<FrameBuffer> frame,
+        ref_mut<DepthBuffer> depth_plane,
+        ref<Vector4<f32>> cs0, ref<Vector4<f32>> cs1, ref<Vector4<f32>> cs2,
+        ref<Vector2<f32>> screen
+        ) {
+        const auto ss0 = screen_space(perspective(cs0), screen);
+        const auto ss1 = screen_space(perspective(cs1), screen);
+        const auto ss2 = screen_space(perspective(cs2), screen);
+        draw_triangle_depth(frame, depth_plane, ss0, ss1, ss2);
+    }
+
+    [[nodiscard]]
+    INLINE static bool alpha_tested(ref<Material> material) {
+        return material.diffuse_map.has_value() && material.diffuse_map->get()->transparent();
+    }
+
     [[clang::always_inline]]
     INLINE static Vector4<f32> perspective(ref<Vector4<f32>> cs) {
         return {
@@ -326,60 +772,73 @@ struct Renderer {
        };
     }
 
-    [[clang::always_inline]]
-    INLINE static std::array<Vector3<f32>, 2> tangent_bitangent(
-        std::array<Vector3<f32>, 3> ws,
-        std::array<Vector3<f32>, 3> uv,
-        const f32 w,
-        ref<Matrix3<f32>> normal_matrix
-        )  {
-        auto edge1 = ws[1] - ws[0];
-        auto edge2 = ws[2] - ws[0];
-        auto delta_uv1 = uv[1] - uv[0];
-        auto delta_uv2 = uv[2] - uv[0];
-
-        auto f = 1.0f / (delta_uv1.x() * delta_uv2.y() - delta_uv2.x() * delta_uv1.y());
-
-        Vector3<f32> tangent{};
-
-        tangent.x() = f * (delta_uv2.y() * edge1.x() - delta_uv1.y() * edge2.x());
-        tangent.y() = f * (delta_uv2.y() * edge1.y() - delta_uv1.y() * edge2.y());
-        tangent.z() = f * (delta_uv2.y() * edge1.z() - delta_uv1.y() * edge2.z());
+    /**
+     * The pixel sample points, which sit on integer coordinates, inside the screen space bounding box of a triangle
+     */
+    struct SampleBounds {
+        isize min_x, max_x, min_y, max_y;
 
-        Vector3<f32> bitangent{};
-
-        bitangent.x() = f * (-delta_uv2.x() * edge1.x() + delta_uv1.x() * edge2.x());
-        bitangent.y() = f * (-delta_uv2.x() * edge1.y() + delta_uv1.x() * edge2.y());
-        bitangent.z() = f * (-delta_uv2.x() * edge1.z() + delta_uv1.x() * edge2.z());
+        [[nodiscard]]
+        bool empty() const {
+            return min_x > max_x || min_y > max_y;
+        }
+    };
 
+    [[clang::always_inline]]
+    INLINE static SampleBounds sample_bounds(ref<Vector3<f32>> ss0, ref<Vector3<f32>> ss1, ref<Vector3<f32>> ss2, ref<FrameBuffer> frame) {
         return {
-            (normal_matrix * tangent) / w,
-            (normal_matrix * bitangent) / w
+            static_cast<isize>(std::max(std::ceil(std::min({ss0.x(), ss1.x(), ss2.x()})), 0.f)),
+            static_cast<isize>(std::min(std::floor(std::max({ss0.x(), ss1.x(), ss2.x()})), static_cast<f32>(frame.width())-1)),
+            static_cast<isize>(std::max(std::ceil(std::min({ss0.y(), ss1.y(), ss2.y()})), 0.f)),
+            static_cast<isize>(std::min(std::floor(std::max({ss0.y(), ss1.y(), ss2.y()})), static_cast<f32>(frame.height())-1)),
         };
     }
 
-
+    // barycentric weights are affine in the sample position, so they are evaluated from precomputed steps without dividing
     #define rasterize_triangle(func) \
-        const auto min_x = std::max(std::min({ss0.x(), ss1.x(), ss2.x()}), 0.f);\
-        const auto max_x = std::min(std::max({ss0.x(), ss1.x(), ss2.x()}), static_cast<f32>(frame.width())-1);\
-        const auto min_y = std::max(std::min({ss0.y(), ss1.y(), ss2.y()}), 0.f);\
-        const auto max_y = std::min(std::max({ss0.y(), ss1.y(), ss2.y()}), static_cast<f32>(frame.height())-1);\
-\
+        const auto bounds = sample_bounds(ss0, ss1, ss2, frame);\
+        if (bounds.empty()) {\
+            return;\
+        }\
 \
         auto denom = (ss1.y() - ss2.y()) * (ss0.x() - ss2.x()) + (ss2.x() - ss1.x()) * (ss0.y() - ss2.y());\
 \
         if (denom == 0.0f) {\
             return;\
         }\
+        const auto inv_denom = 1.0f / denom;\
+        const auto w0_dx = (ss1.y() - ss2.y()) * inv_denom;\
+        const auto w0_dy = (ss2.x() - ss1.x()) * inv_denom;\
+        const auto w1_dx = (ss2.y() - ss0.y()) * inv_denom;\
+        const auto w1_dy = (ss0.x() - ss2.x()) * inv_denom;\
 \
+        /* most small triangles cover at most a 2x2 box of samples, which is tested sample by sample without the scanning below */\
+        if (bounds.max_x - bounds.min_x <= 1 && bounds.max_y - bounds.min_y <= 1) {\
+            for (isize sample = 0; sample < 4; sample++) {\
+                const auto x = bounds.min_x + (sample & 1);\
+                const auto y = bounds.min_y + (sample >> 1);\
+                if (x > bounds.max_x || y > bounds.max_y) continue;\
+                const auto dx = static_cast<f32>(x) - ss2.x();\
+                const auto dy = static_cast<f32>(y) - ss2.y();\
+                auto w0 = w0_dx * dx + w0_dy * dy;\
+                auto w1 = w1_dx * dx + w1_dy * dy;\
+                auto w2 = 1.0f - w0 - w1;\
+                if (w0 >= 0.0 && w1 >= 0.0 && w2 >= 0.0) {\
+                    Vector2<usize> pix{static_cast<usize>(x), static_cast<usize>(y)};\
+                    func\
+                }\
+            }\
+            return;\
+        }\
 \
-        for (auto y = static_cast<isize>(min_y); y <= static_cast<isize>(max_y); y++) {\
+        for (auto y = bounds.min_y; y <= bounds.max_y; y++) {\
             bool encounteredX = false;\
-            for (auto x = static_cast<isize>(min_x); x <= static_cast<isize>(max_x); x++) {\
-                Vector2<f32> pf{static_cast<f32>(x), static_cast<f32>(y)};\
+            const auto dy = static_cast<f32>(y) - ss2.y();\
+            for (auto x = bounds.min_x; x <= bounds.max_x; x++) {\
+                const auto dx = static_cast<f32>(x) - ss2.x();\
 \
-                auto w0 = ((ss1.y() - ss2.y()) * (pf.x() - ss2.x()) + (ss2.x() - ss1.x()) * (pf.y() - ss2.y())) / denom;\
-                auto w1 = ((ss2.y() - ss0.y()) * (pf.x() - ss2.x()) + (ss0.x() - ss2.x()) * (pf.y() - ss2.y())) / denom;\
+                auto w0 = w0_dx * dx + w0_dy * dy;\
+                auto w1 = w1_dx * dx + w1_dy * dy;\
                 auto w2 = 1.0f - w0 - w1;\
 \
                 if (w0 >= 0.0 && w1 >= 0.0 && w2 >= 0.0) {\
@@ -395,6 +854,7 @@ struct Renderer {
     [[clang::always_inline]]
     INLINE static void draw_triangle_filled_textured(
             ref_mut<FrameBuffer> frame,
+            ptr<DepthBuffer> depth_plane,
             Vector3<f32> ss0, Vector3<f32> ss1, Vector3<f32> ss2,
             Vector3<f32> ws0, Vector3<f32> ws1, Vector3<f32> ws2,
             Vector3<f32> n0, Vector3<f32> n1, Vector3<f32> n2,
@@ -409,11 +869,14 @@ struct Renderer {
             TextureId specular_map,
             TextureId normal_map
         ) {
+        auto& stats = RenderStats::local();
         rasterize_triangle({
 
+            stats[RenderStats::Counter::PixelsTested]++;
             if (pix.x() < 0 || pix.x() > frame.width() || pix.y() < 0 || pix.y() > frame.height()) continue;
             auto depth = w0 * ss0.z() + w1 * ss1.z() + w2 * ss2.z();
             if (depth > 1 || depth < 0) continue;
+            if (depth_plane && depth_plane->behind(pix, convert_depth(depth), DEPTH_PREPASS_BIAS)) continue;
 
             auto pix_uv = uv0 * w0 + uv1 * w1 + uv2 * w2;
             auto frac_1_w = pix_uv.z();
@@ -429,6 +892,8 @@ struct Renderer {
             if (pixel.depth >= frame[pix].depth) {
                 continue;
             }
+            stats[RenderStats::Counter::DepthPasses]++;
+            if (frame.heatmap() == Heatmaps::Overdraw) frame.add_heat(pix, 1);
             pixel.ambient = ambient;
             pixel.specular = specular;
             pixel.diffuse = color.xyz();
@@ -441,13 +906,14 @@ struct Renderer {
             pixel.bitangent = (bt0 * w0 + bt1 * w1 + bt2 * w2)/frac_1_w;
             pixel.position = (ws0 * w0 + ws1 * w1 + ws2 * w2)/frac_1_w;
             pixel.normal_map = normal_map;
-            frame[pix].set_smaller_depth(pixel);
+            stats[RenderStats::Counter::LockRetries] += frame[pix].set_smaller_depth(pixel);
         });
     }
 
     [[clang::always_inline]]
     INLINE static void draw_triangle_filled_textured_deferred(
             ref_mut<FrameBuffer> frame,
+            ptr<DepthBuffer> depth_plane,
             Vector3<f32> ss0, Vector3<f32> ss1, Vector3<f32> ss2,
             Vector3<f32> ws0, Vector3<f32> ws1, Vector3<f32> ws2,
             Vector3<f32> n0, Vector3<f32> n1, Vector3<f32> n2,
@@ -464,11 +930,14 @@ struct Renderer {
             TextureId normal_map
         ) {
 
+        auto& stats = RenderStats::local();
         rasterize_triangle({
 
+            stats[RenderStats::Counter::PixelsTested]++;
             if (pix.x() < 0 || pix.x() > frame.width() || pix.y() < 0 || pix.y() > frame.height()) continue;
             auto depth = w0 * ss0.z() + w1 * ss1.z() + w2 * ss2.z();
             if (depth > 1 || depth < 0) continue;
+            if (depth_plane && depth_plane->behind(pix, convert_depth(depth), DEPTH_PREPASS_BIAS)) continue;
 
             auto pix_uv = uv0 * w0 + uv1 * w1 + uv2 * w2;
             auto frac_1_w = pix_uv.z();
@@ -479,6 +948,8 @@ struct Renderer {
             if (pixel.depth >= frame[pix].depth) {
                 continue;
             }
+            stats[RenderStats::Counter::DepthPasses]++;
+            if (frame.heatmap() == Heatmaps::Overdraw) frame.add_heat(pix, 1);
             pixel.ambient = ambient;
             pixel.diffuse = diffuse;
             pixel.specular = specular;
@@ -492,7 +963,22 @@ struct Renderer {
             pixel.bitangent = ((bt0 * w0 + bt1 * w1 + bt2 * w2)/frac_1_w).xyz();
             pixel.position = (ws0 * w0 + ws1 * w1 + ws2 * w2)/frac_1_w;
             pixel.normal_map = normal_map;
-            frame[pix].set_smaller_depth(pixel);
+            stats[RenderStats::Counter::LockRetries] += frame[pix].set_smaller_depth(pixel);
+        });
+    }
+
+    [[clang::always_inline]]
+    INLINE static void draw_triangle_depth(
+            ref_mut<FrameBuffer> frame,
+            ref_mut<DepthBuffer> depth_plane,
+            Vector3<f32> ss0, Vector3<f32> ss1, Vector3<f32> ss2
+        ) {
+        auto& stats = RenderStats::local();
+        rasterize_triangle({
+            stats[RenderStats::Counter::PixelsTested]++;
+            auto depth = w0 * ss0.z() + w1 * ss1.z() + w2 * ss2.z();
+            if (depth > 1 || depth < 0) continue;
+            depth_plane.set_smaller(pix, convert_depth(depth));
         });
     }
 
@@ -5,6 +5,10 @@
 #ifndef SCENE_H
 #define SCENE_H
 
+#include <limits>
+#include <memory>
+#include <vector>
+
 #include <resources/obj.h>
 #include <util/vec_math.h>
 
@@ -12,7 +16,8 @@ class Camera {
 public:
     Vector3<f32> up{0, 1, 0};
     Vector3<f32> target{0, 0, 0};
-    Vector3<f32> position{0, 0, 0};
+    // away from the target, looking at it from where it is has no direction
+    Vector3<f32> position{0, 0, 1};
     f32 fov{M_PI/3};
     f32 zoom{1.f};
 
@@ -40,32 +45,229 @@ public:
 };
 
 /**
- * All the objects and lights in the scene as well as the camera
+ * The part of a scene shading reads, copied so the scene can move on to the next frame while one is still being shaded
+ */
+class SceneView {
+public:
+    std::vector<Light> m_lights{};
+    Camera m_camera{};
+};
+
+/**
+ * One object of the scene, either a mesh or a group the children of which are positioned relative to it.
+ * The matrices placing it in the world are cached and only recomputed when its transform or one of its parents' changes.
+ */
+class SceneNode {
+    friend class Scene;
+    static constexpr usize NO_PARENT = std::numeric_limits<usize>::max();
+
+    usize m_parent{NO_PARENT};
+    // the node this one copies the contents of once that is loaded
+    usize m_instance_of{NO_PARENT};
+    ptr<Material> m_resolved_material{nullptr};
+    // the transform the cached matrices were computed from
+    Vector3<f32> m_cached_position{};
+    Vector3<f32> m_cached_rotation{};
+    Vector3<f32> m_cached_scale{};
+    bool m_dirty{true};
+    Matrix4<f32> m_local{};
+    Matrix4<f32> m_world{};
+    Matrix4<f32> m_world_inverse{};
+    Matrix3<f32> m_normal_matrix{};
+
+public:
+    Vector3<f32> m_position{0, 0, 0};
+    Vector3<f32> m_rotation{0, 0, 0};
+    Vector3<f32> m_scale{1, 1, 1};
+    // null for groups, meshes are immutable and may be shared by many nodes
+    std::shared_ptr<const Mesh> m_mesh{};
+    // replaces the material of the mesh of this node and of every node below it without an override of its own
+    std::shared_ptr<const Material> m_material{};
+
+    [[nodiscard]]
+    Matrix4<f32> model() const {
+        const Matrix4<f32> rotation{Matrix3<f32>::rotation(m_rotation)};
+        const Matrix4<f32> scale{
+            m_scale.x(), 0, 0, 0,
+            0, m_scale.y(), 0, 0,
+            0, 0, m_scale.z(), 0,
+            0, 0, 0, 1
+        };
+        auto model = rotation*scale;
+        model[{0, 3}] = m_position.x();
+        model[{1, 3}] = m_position.y();
+        model[{2, 3}] = m_position.z();
+        model[{3, 3}] = 1;
+        return model;
+    }
+
+    [[nodiscard]]
+    ref<Matrix4<f32>> world() const {
+        return m_world;
+    }
+
+    [[nodiscard]]
+    ref<Matrix4<f32>> world_inverse() const {
+        return m_world_inverse;
+    }
+
+    [[nodiscard]]
+    ref<Matrix3<f32>> normal_matrix() const {
+        return m_normal_matrix;
+    }
+
+    /**
+     * @return the material to draw the mesh with, as of the last Scene::update_transforms
+     */
+    [[nodiscard]]
+    ref<Material> material() const {
+        return m_resolved_material ? *m_resolved_material : m_mesh->m_material;
+    }
+};
+
+/**
+ * All the objects and lights in the scene as well as the camera.
+ * Objects are flattened into a list of nodes in which every parent comes before its children.
  */
 class Scene {
-    std::vector<Object> m_objects{};
+    std::vector<SceneNode> m_nodes{};
+
+    /**
+     * Appends the node for object and its children, moving its meshes out of it
+     * @return the index of the node for object
+     */
+    usize flatten(Object&& object, usize parent) {
+        const auto index = m_nodes.size();
+        m_nodes.emplace_back();
+        m_nodes[index].m_parent = parent;
+        m_nodes[index].m_position = object.m_position;
+        m_nodes[index].m_rotation = object.m_rotation;
+        m_nodes[index].m_scale = object.m_scale;
+        add_contents(index, std::move(object));
+        return index;
+    }
+
+    void add_contents(usize index, Object&& object) {
+        if (object.m_kind.index() == 0) {
+            m_nodes[index].m_mesh = std::make_shared<const Mesh>(std::move(std::get<Mesh>(object.m_kind)));
+        } else {
+            for (auto& child : std::get<std::vector<Object>>(object.m_kind)) {
+                flatten(std::move(child), index);
+            }
+        }
+    }
+
+    /**
+     * Appends copies of the nodes below source as children of target, the copies share the meshes of the originals
+     */
+    void copy_children(usize source, usize target) {
+        // children always come after their parent so a single pass in order sees every descendant
+        std::vector<usize> copies(m_nodes.size(), SceneNode::NO_PARENT);
+        copies[source] = target;
+        const auto end = m_nodes.size();
+        for (usize i = source + 1; i < end; i++) {
+            const auto parent = m_nodes[i].m_parent;
+            if (parent == SceneNode::NO_PARENT || copies[parent] == SceneNode::NO_PARENT) continue;
+            copies[i] = m_nodes.size();
+            auto copy = m_nodes[i];
+            copy.m_parent = copies[parent];
+            copy.m_instance_of = SceneNode::NO_PARENT;
+            copy.m_dirty = true;
+            m_nodes.push_back(std::move(copy));
+        }
+    }
+
 public:
     std::vector<Light> m_lights{};
     Camera m_camera{};
 
     ObjectId add_object(Object&& obj) {
-        m_objects.push_back(obj);
-        return ObjectId(this->m_objects.size()-1);
+        return ObjectId(flatten(std::move(obj), SceneNode::NO_PARENT));
+    }
+
+    /**
+     * Adds another instance of an object, sharing its meshes rather than copying them.
+     * The instance starts with the transform and material override of the original, which can then be changed independently.
+     * Instancing an object that is still empty because it is loading fills the instance when the object is loaded.
+     */
+    ObjectId instantiate(const ObjectId prototype) {
+        const auto index = m_nodes.size();
+        auto node = m_nodes[prototype.idx];
+        node.m_parent = SceneNode::NO_PARENT;
+        // an instance of an instance that is still waiting waits for the same object
+        if (node.m_instance_of == SceneNode::NO_PARENT) {
+            node.m_instance_of = prototype.idx;
+        }
+        node.m_dirty = true;
+        m_nodes.push_back(std::move(node));
+        copy_children(prototype.idx, index);
+        return ObjectId(index);
+    }
+
+    /**
+     * Gives an object that was added empty the meshes and children of another, keeping its own transform.
+     * Instances made of it while it was empty get the same contents.
+     */
+    void set_contents(const ObjectId id, Object&& object) {
+        add_contents(id.idx, std::move(object));
+        const auto end = m_nodes.size();
+        for (usize i = 0; i < end; i++) {
+            if (m_nodes[i].m_instance_of != id.idx) continue;
+            m_nodes[i].m_mesh = m_nodes[id.idx].m_mesh;
+            m_nodes[i].m_instance_of = SceneNode::NO_PARENT;
+            copy_children(id.idx, i);
+        }
     }
 
     [[nodiscard]]
-    ref<std::vector<Object>> objects() const {
-        return this->m_objects;
+    ref<std::vector<SceneNode>> nodes() const {
+        return this->m_nodes;
     }
 
     [[nodiscard]]
-    ref<Object> operator[](const ObjectId id) const {
-        return this->m_objects[id.idx];
+    ref<SceneNode> operator[](const ObjectId id) const {
+        return this->m_nodes[id.idx];
+    }
+
+    [[nodiscard]]
+    ref_mut<SceneNode> operator[](const ObjectId id) {
+        return this->m_nodes[id.idx];
+    }
+
+    /**
+     * Recomputes the cached matrices of nodes whose transform changed since the last update, and of their children,
+     * and resolves which material override applies to each node
+     */
+    void update_transforms() {
+        for (auto& node : m_nodes) {
+            if (node.m_position != node.m_cached_position || node.m_rotation != node.m_cached_rotation || node.m_scale != node.m_cached_scale) {
+                node.m_cached_position = node.m_position;
+                node.m_cached_rotation = node.m_rotation;
+                node.m_cached_scale = node.m_scale;
+                node.m_local = node.model();
+                node.m_dirty = true;
+            }
+            const auto parent = node.m_parent == SceneNode::NO_PARENT ? nullptr : &m_nodes[node.m_parent];
+            if (parent && parent->m_dirty) {
+                node.m_dirty = true;
+            }
+            node.m_resolved_material = node.m_material ? node.m_material.get() : parent ? parent->m_resolved_material : nullptr;
+        }
+        // parents come first so a dirty parent has its world matrix by the time its children need it
+        for (auto& node : m_nodes) {
+            if (!node.m_dirty) continue;
+            node.m_world = node.m_parent == SceneNode::NO_PARENT ? node.m_local : m_nodes[node.m_parent].m_world * node.m_local;
+            node.m_world_inverse = node.m_world.inverse();
+            node.m_normal_matrix = Matrix3<f32>{node.m_world_inverse.transpose()};
+        }
+        for (auto& node : m_nodes) {
+            node.m_dirty = false;
+        }
     }
 
     [[nodiscard]]
-    ref_mut<Object> operator[](const ObjectId id) {
-        return this->m_objects[id.idx];
+    SceneView view() const {
+        return {m_lights, m_camera};
     }
 
     [[nodiscard]]
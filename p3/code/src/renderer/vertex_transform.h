@@ -0,0 +1,149 @@
+#ifndef VERTEX_TRANSFORM_H
+#define VERTEX_TRANSFORM_H
+
+#include <vector>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#include <util/types.h>
+#include <util/vec_math.h>
+
+/**
+ * Which clip space planes a vertex lies outside of, a triangle with all its vertices outside the same plane cannot be visible
+ */
+namespace Outcode {
+    constexpr u8 LEFT = 1 << 0;
+    constexpr u8 RIGHT = 1 << 1;
+    constexpr u8 BOTTOM = 1 << 2;
+    constexpr u8 TOP = 1 << 3;
+    constexpr u8 NEAR = 1 << 4;
+    constexpr u8 FAR = 1 << 5;
+}
+
+/**
+ * Vertex positions moved into world and clip space, stored as one array per component
+ */
+struct TransformedVertices {
+    std::vector<f32> wx, wy, wz;
+    std::vector<f32> cx, cy, cz, cw;
+    std::vector<u8> outcodes;
+
+    void resize(usize size) {
+        for (auto component : {&wx, &wy, &wz, &cx, &cy, &cz, &cw}) {
+            component->resize(size);
+        }
+        outcodes.resize(size);
+    }
+
+    [[nodiscard]]
+    INLINE Vector4<f32> world(usize i) const {
+        return {wx[i], wy[i], wz[i], 1};
+    }
+
+    [[nodiscard]]
+    INLINE Vector4<f32> clip(usize i) const {
+        return {cx[i], cy[i], cz[i], cw[i]};
+    }
+};
+
+INLINE inline u8 outcode(f32 x, f32 y, f32 z, f32 w) {
+    return (x < -w ? Outcode::LEFT : 0)
+        | (x > w ? Outcode::RIGHT : 0)
+        | (y < -w ? Outcode::BOTTOM : 0)
+        | (y > w ? Outcode::TOP : 0)
+        | (z < -w ? Outcode::NEAR : 0)
+        | (z > w ? Outcode::FAR : 0);
+}
+
+/**
+ * Transforms the positions in [begin, end) by the model matrix into world space and by the combined
+ * model view projection matrix into clip space, computing the outcode of every vertex on the way.
+ * With AVX eight vertices are transformed per iteration.
+ */
+inline void transform_vertices(
+    ptr<f32> x, ptr<f32> y, ptr<f32> z,
+    usize begin, usize end,
+    ref<Matrix4<f32>> model, ref<Matrix4<f32>> proj_view,
+    ref_mut<TransformedVertices> out
+    ) {
+    const auto mvp = proj_view * model;
+    usize i = begin;
+
+#ifdef __AVX__
+    #ifdef __FMA__
+    #define MUL_ADD(a, b, c) _mm256_fmadd_ps(a, b, c)
+    #else
+    #define MUL_ADD(a, b, c) _mm256_add_ps(_mm256_mul_ps(a, b), c)
+    #endif
+
+    __m256 m[3][4];
+    __m256 p[4][4];
+    for (usize r = 0; r < 4; r++) {
+        for (usize c = 0; c < 4; c++) {
+            if (r < 3) m[r][c] = _mm256_set1_ps(model[{r, c}]);
+            p[r][c] = _mm256_set1_ps(mvp[{r, c}]);
+        }
+    }
+
+    const auto bit = [](u8 value) { return _mm256_castsi256_ps(_mm256_set1_epi32(value)); };
+    const __m256 left = bit(Outcode::LEFT), right = bit(Outcode::RIGHT), bottom = bit(Outcode::BOTTOM);
+    const __m256 top = bit(Outcode::TOP), near = bit(Outcode::NEAR), far = bit(Outcode::FAR);
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+
+    for (; i + 8 <= end; i += 8) {
+        const auto vx = _mm256_loadu_ps(x + i);
+        const auto vy = _mm256_loadu_ps(y + i);
+        const auto vz = _mm256_loadu_ps(z + i);
+
+        __m256 world[3];
+        for (usize r = 0; r < 3; r++) {
+            world[r] = MUL_ADD(m[r][0], vx, MUL_ADD(m[r][1], vy, MUL_ADD(m[r][2], vz, m[r][3])));
+        }
+        __m256 clip[4];
+        for (usize r = 0; r < 4; r++) {
+            clip[r] = MUL_ADD(p[r][0], vx, MUL_ADD(p[r][1], vy, MUL_ADD(p[r][2], vz, p[r][3])));
+        }
+
+        _mm256_storeu_ps(out.wx.data() + i, world[0]);
+        _mm256_storeu_ps(out.wy.data() + i, world[1]);
+        _mm256_storeu_ps(out.wz.data() + i, world[2]);
+        _mm256_storeu_ps(out.cx.data() + i, clip[0]);
+        _mm256_storeu_ps(out.cy.data() + i, clip[1]);
+        _mm256_storeu_ps(out.cz.data() + i, clip[2]);
+        _mm256_storeu_ps(out.cw.data() + i, clip[3]);
+
+        const auto w = clip[3];
+        const auto neg_w = _mm256_xor_ps(w, sign);
+        auto codes = _mm256_and_ps(_mm256_cmp_ps(clip[0], neg_w, _CMP_LT_OQ), left);
+        codes = _mm256_or_ps(codes, _mm256_and_ps(_mm256_cmp_ps(clip[0], w, _CMP_GT_OQ), right));
+        codes = _mm256_or_ps(codes, _mm256_and_ps(_mm256_cmp_ps(clip[1], neg_w, _CMP_LT_OQ), bottom));
+        codes = _mm256_or_ps(codes, _mm256_and_ps(_mm256_cmp_ps(clip[1], w, _CMP_GT_OQ), top));
+        codes = _mm256_or_ps(codes, _mm256_and_ps(_mm256_cmp_ps(clip[2], neg_w, _CMP_LT_OQ), near));
+        codes = _mm256_or_ps(codes, _mm256_and_ps(_mm256_cmp_ps(clip[2], w, _CMP_GT_OQ), far));
+
+        // narrow the eight 32 bit codes down to eight bytes
+        const auto codes_i = _mm256_castps_si256(codes);
+        const auto words = _mm_packus_epi32(_mm256_castsi256_si128(codes_i), _mm256_extractf128_si256(codes_i, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out.outcodes.data() + i), _mm_packus_epi16(words, words));
+    }
+    #undef MUL_ADD
+#endif
+
+    for (; i < end; i++) {
+        const auto ms = Vector4<f32>{x[i], y[i], z[i], 1};
+        const auto ws = model * ms;
+        const auto cs = mvp * ms;
+        out.wx[i] = ws.x();
+        out.wy[i] = ws.y();
+        out.wz[i] = ws.z();
+        out.cx[i] = cs.x();
+        out.cy[i] = cs.y();
+        out.cz[i] = cs.z();
+        out.cw[i] = cs.w();
+        out.outcodes[i] = outcode(cs.x(), cs.y(), cs.z(), cs.w());
+    }
+}
+
+#endif //VERTEX_TRANSFORM_H
@@ -0,0 +1,228 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <resources/meshlet.h>
+#include <resources/mesh_simplifier.h>
+#include <resources/texture.h>
+#include <util/buffer.h>
+#include <util/vec_math.h>
+
+class Material {
+public:
+    Vector3<f32> ambient;
+    Vector3<f32> diffuse;
+    Vector3<f32> specular;
+    u32 shininess{0};
+    std::optional<std::shared_ptr<const Texture>> ambient_map;
+    std::optional<std::shared_ptr<const Texture>> diffuse_map;
+    std::optional<std::shared_ptr<const Texture>> specular_map;
+    std::optional<std::shared_ptr<const Texture>> normal_map;
+};
+
+/**
+ * An axis aligned bounding box
+ */
+class Bounds {
+public:
+    Vector3<f32> min{std::numeric_limits<f32>::max(), std::numeric_limits<f32>::max(), std::numeric_limits<f32>::max()};
+    Vector3<f32> max{std::numeric_limits<f32>::lowest(), std::numeric_limits<f32>::lowest(), std::numeric_limits<f32>::lowest()};
+
+    void extend(ref<Vector3<f32>> point) {
+        for (usize i = 0; i < 3; i++) {
+            min[i] = std::min(min[i], point[i]);
+            max[i] = std::max(max[i], point[i]);
+        }
+    }
+
+    [[nodiscard]]
+    bool empty() const {
+        return min.x() > max.x();
+    }
+
+    [[nodiscard]]
+    Vector3<f32> center() const {
+        return (min + max) * 0.5f;
+    }
+};
+
+/**
+ * The vertex attributes of a mesh, each vertex is stored once and shared by every triangle that references it.
+ * Positions are split into one array per component so they can be transformed several vertices at a time.
+ */
+class Vertices {
+public:
+    Buffer<f32> x{};
+    Buffer<f32> y{};
+    Buffer<f32> z{};
+    Buffer<Vector3<f32>> normals{};
+    Buffer<Vector2<f32>> uvs{};
+    // unit tangent in xyz, perpendicular to the normal, and in w the sign of the bitangent, which is w * cross(normal, tangent)
+    Buffer<Vector4<f32>> tangents{};
+
+    [[nodiscard]]
+    usize size() const {
+        return x.size();
+    }
+
+    [[nodiscard]]
+    Vector3<f32> position(usize i) const {
+        return {x[i], y[i], z[i]};
+    }
+
+    /**
+     * Computes the tangent frames from the uvs, the same way MikkTSpace does for vertices that are not split:
+     * every triangle contributes its uv aligned tangent, projected onto the plane of the vertex normal and
+     * weighted by the angle of the triangle at that vertex. The bitangent sign is the one most triangles agree on.
+     */
+    void generate_tangents(ref<Buffer<u32>> indices) {
+        std::vector<Vector3<f32>> sums(size(), Vector3<f32>{0, 0, 0});
+        std::vector<f32> signs(size(), 0);
+
+        for (usize t = 0; t < indices.size(); t += 3) {
+            const std::array<u32, 3> corner{indices[t], indices[t + 1], indices[t + 2]};
+            const std::array<Vector3<f32>, 3> p{position(corner[0]), position(corner[1]), position(corner[2])};
+            const auto edge1 = p[1] - p[0];
+            const auto edge2 = p[2] - p[0];
+            const auto delta_uv1 = uvs[corner[1]] - uvs[corner[0]];
+            const auto delta_uv2 = uvs[corner[2]] - uvs[corner[0]];
+
+            const auto area = delta_uv1.x() * delta_uv2.y() - delta_uv2.x() * delta_uv1.y();
+            if (area == 0) continue;
+            const auto tangent = (edge1 * delta_uv2.y() - edge2 * delta_uv1.y()) / area;
+            const auto bitangent = (edge2 * delta_uv1.x() - edge1 * delta_uv2.x()) / area;
+
+            for (usize c = 0; c < 3; c++) {
+                const auto& n = normals[corner[c]];
+                const auto projected = tangent - n * n.dot(tangent);
+                if (projected.magnitude_squared() <= 0) continue;
+
+                const auto to_next = p[(c + 1) % 3] - p[c];
+                const auto to_prev = p[(c + 2) % 3] - p[c];
+                const auto lengths = std::sqrt(to_next.magnitude_squared() * to_prev.magnitude_squared());
+                if (lengths <= 0) continue;
+                const auto angle = std::acos(std::clamp(to_next.dot(to_prev) / lengths, -1.f, 1.f));
+
+                sums[corner[c]] = sums[corner[c]] + projected.normalize() * angle;
+                signs[corner[c]] += n.cross(tangent).dot(bitangent) < 0 ? -angle : angle;
+            }
+        }
+
+        std::vector<Vector4<f32>> result(size());
+        for (usize v = 0; v < size(); v++) {
+            const auto& n = normals[v];
+            auto tangent = sums[v] - n * n.dot(sums[v]);
+            if (tangent.magnitude_squared() <= 0) {
+                // no usable uvs, any direction along the surface will do
+                tangent = std::abs(n.x()) < 0.9f ? Vector3<f32>{1, 0, 0} : Vector3<f32>{0, 1, 0};
+                tangent = tangent - n * n.dot(tangent);
+            }
+            if (tangent.magnitude_squared() > 0) {
+                tangent = tangent.normalize();
+            }
+            result[v] = {tangent.x(), tangent.y(), tangent.z(), signs[v] < 0 ? -1.f : 1.f};
+        }
+        tangents = std::move(result);
+    }
+};
+
+/**
+ * A simplified version of the triangles of a mesh, indexing the same vertices as the full mesh
+ */
+class MeshLod {
+public:
+    Buffer<u32> indices{};
+    Meshlets meshlets{};
+    // how far, in model space, the simplified surface may be from the full one
+    f32 error{0};
+};
+
+/**
+ * Triangles sharing one material, every three indices into the vertices form a triangle.
+ * The same triangles are also grouped into meshlets, which is how the renderer draws them.
+ * Coarser levels of detail, each with about half the triangles of the one before, are kept in m_lods.
+ */
+class Mesh {
+public:
+    static constexpr usize MAX_LODS = 4;
+    // meshes this small are cheap enough to always draw in full
+    static constexpr usize MIN_LOD_TRIANGLES = 256;
+    // a level that cannot get below this fraction of the triangles of the previous one is not worth keeping
+    static constexpr f32 MIN_LOD_REDUCTION = 0.8f;
+    // largest error a single level may add, as a fraction of the diagonal of the mesh bounds
+    static constexpr f32 MAX_LOD_ERROR = 0.05f;
+
+    std::string name{};
+    Vertices m_vertices{};
+    Buffer<u32> m_indices{};
+    Meshlets m_meshlets{};
+    std::vector<MeshLod> m_lods{};
+    Material m_material{};
+    Bounds m_bounds{};
+
+    Mesh(std::string name, Vertices vertices, Buffer<u32> indices, Meshlets meshlets, std::vector<MeshLod> lods, Material material, Bounds bounds) : name {std::move(name)}, m_vertices{std::move(vertices)}, m_indices{std::move(indices)}, m_meshlets{std::move(meshlets)}, m_lods{std::move(lods)}, m_material{std::move(material)}, m_bounds{bounds} {}
+    Mesh(std::string name, Vertices vertices, Buffer<u32> indices, Material material) : Mesh(std::move(name), std::move(vertices), std::move(indices), Meshlets{}, {}, std::move(material), Bounds{}) {
+        for (usize i = 0; i < m_vertices.size(); i++) {
+            m_bounds.extend(m_vertices.position(i));
+        }
+        m_vertices.generate_tangents(m_indices);
+        m_meshlets = Meshlets::build(m_indices, m_vertices.x, m_vertices.y, m_vertices.z);
+        build_lods();
+    }
+    Mesh()= default;
+
+    [[nodiscard]]
+    usize triangles() const {
+        return m_indices.size() / 3;
+    }
+
+    /**
+     * @return how many levels of detail there are, level 0 being the full mesh
+     */
+    [[nodiscard]]
+    usize lod_count() const {
+        return m_lods.size() + 1;
+    }
+
+    [[nodiscard]]
+    ref<Meshlets> meshlets(usize lod) const {
+        return lod == 0 ? m_meshlets : m_lods[lod - 1].meshlets;
+    }
+
+    [[nodiscard]]
+    f32 lod_error(usize lod) const {
+        return lod == 0 ? 0 : m_lods[lod - 1].error;
+    }
+
+private:
+    void build_lods() {
+        if (m_bounds.empty()) return;
+        const auto max_error = (m_bounds.max - m_bounds.min).magnitude() * MAX_LOD_ERROR;
+
+        std::vector<u32> current(m_indices.begin(), m_indices.end());
+        f32 error = 0;
+        while (m_lods.size() < MAX_LODS && current.size() / 3 > MIN_LOD_TRIANGLES) {
+            f32 level_error = 0;
+            auto simplified = MeshSimplifier::simplify(current, m_vertices.x, m_vertices.y, m_vertices.z, current.size() / 6 * 3, max_error, level_error);
+            if (static_cast<f32>(simplified.size()) > static_cast<f32>(current.size()) * MIN_LOD_REDUCTION) break;
+
+            // every level simplifies the one before it, so their errors add up
+            error += level_error;
+            current = simplified;
+            Buffer<u32> indices{std::move(simplified)};
+            auto meshlets = Meshlets::build(indices, m_vertices.x, m_vertices.y, m_vertices.z);
+            m_lods.push_back(MeshLod{std::move(indices), std::move(meshlets), error});
+        }
+    }
+};
+
+#endif //MESH_H
@@ -0,0 +1,292 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <resources/mesh.h>
+#include <resources/resource_store.h>
+#include <util/blob.h>
+#include <util/mapped_file.h>
+
+/**
+ * Compiled form of the meshes loaded from an OBJ file, kept next to the source as <source>.meshcache.
+ *
+ * The mesh data is mapped and used in place, so loading a cached file costs about as much as reading its materials.
+ * A cache file is only used while the size and modification time of its source and of the material libraries it
+ * read still match.
+ */
+class MeshCache {
+    static constexpr u32 MAGIC = 0x4843534d; // MSCH
+    static constexpr u32 VERSION = 8;
+
+    struct Header {
+        u32 magic;
+        u32 version;
+        u64 source_size;
+        i64 source_mtime;
+        BlobSpan dependencies;
+        BlobSpan meshes;
+    };
+
+    /**
+     * Another file the meshes were built from, like a material library
+     */
+    struct DependencyRecord {
+        BlobSpan path;
+        u64 size;
+        i64 mtime;
+    };
+
+    struct MaterialRecord {
+        Vector3<f32> ambient;
+        Vector3<f32> diffuse;
+        Vector3<f32> specular;
+        u32 shininess;
+        BlobSpan ambient_map;
+        BlobSpan diffuse_map;
+        BlobSpan specular_map;
+        BlobSpan normal_map;
+    };
+
+    struct LodRecord {
+        f32 error;
+        BlobSpan indices;
+        BlobSpan meshlets;
+        BlobSpan meshlet_vertices;
+        BlobSpan meshlet_triangles;
+    };
+
+    struct MeshRecord {
+        BlobSpan name;
+        MaterialRecord material;
+        Vector3<f32> bounds_min;
+        Vector3<f32> bounds_max;
+        BlobSpan x;
+        BlobSpan y;
+        BlobSpan z;
+        BlobSpan normals;
+        BlobSpan uvs;
+        BlobSpan tangents;
+        BlobSpan indices;
+        BlobSpan meshlets;
+        BlobSpan meshlet_vertices;
+        BlobSpan meshlet_triangles;
+        BlobSpan lods;
+    };
+
+    [[nodiscard]]
+    static BlobSpan append_texture(ref_mut<BlobWriter> writer, ref<std::optional<std::shared_ptr<const Texture>>> texture) {
+        if (!texture.has_value()) return {};
+        return writer.append((*texture)->path());
+    }
+
+    template<typename T>
+    [[nodiscard]]
+    static std::optional<Buffer<T>> read_buffer(ref<std::shared_ptr<const MappedFile>> file, ref<BlobSpan> span) {
+        const auto data = file->at<T>(span.offset, span.count);
+        if (!data) return std::nullopt;
+        return Buffer<T>{data, span.count, file};
+    }
+
+    [[nodiscard]]
+    static std::optional<std::string> read_string(ref<MappedFile> file, ref<BlobSpan> span) {
+        const auto str = file.at<char>(span.offset, span.count);
+        if (!str) return std::nullopt;
+        return std::string(str, span.count);
+    }
+
+public:
+    [[nodiscard]]
+    static std::string path_for(ref<std::string> source) {
+        return source + ".meshcache";
+    }
+
+    /**
+     * @return the meshes cached for the source if the cache exists and is still up to date
+     */
+    [[nodiscard]]
+    static std::optional<std::vector<Mesh>> load(ref<std::string> source, ref_mut<ResourceStore> resource_store) {
+        const auto stamp = FileStamp::of(source);
+        if (!stamp) return std::nullopt;
+
+        auto mapped = MappedFile::open(path_for(source));
+        if (!mapped) return std::nullopt;
+        const auto file = std::make_shared<const MappedFile>(std::move(*mapped));
+
+        const auto header = file->at<Header>(0);
+        if (!header
+            || header->magic != MAGIC
+            || header->version != VERSION
+            || FileStamp{header->source_size, header->source_mtime} != *stamp) {
+            return std::nullopt;
+        }
+
+        const auto dependencies = file->at<DependencyRecord>(header->dependencies.offset, header->dependencies.count);
+        if (header->dependencies.count != 0 && !dependencies) return std::nullopt;
+        for (usize i = 0; i < header->dependencies.count; i++) {
+            const auto path = read_string(*file, dependencies[i].path);
+            if (!path) return std::nullopt;
+            const auto dependency_stamp = FileStamp::of(*path);
+            if (!dependency_stamp || FileStamp{dependencies[i].size, dependencies[i].mtime} != *dependency_stamp) return std::nullopt;
+        }
+
+        const auto records = file->at<MeshRecord>(header->meshes.offset, header->meshes.count);
+        if (!records) return std::nullopt;
+
+        const auto texture = [&](ref<BlobSpan> span, auto load) -> std::optional<std::optional<std::shared_ptr<const Texture>>> {
+            if (span.count == 0) return std::optional<std::shared_ptr<const Texture>>{};
+            auto path = read_string(*file, span);
+            if (!path) return std::nullopt;
+            return std::optional{load(*path)};
+        };
+
+        std::vector<Mesh> meshes{};
+        for (usize i = 0; i < header->meshes.count; i++) {
+            const auto& record = records[i];
+            const auto name = read_string(*file, record.name);
+            auto x = read_buffer<f32>(file, record.x);
+            auto y = read_buffer<f32>(file, record.y);
+            auto z = read_buffer<f32>(file, record.z);
+            auto normals = read_buffer<Vector3<f32>>(file, record.normals);
+            auto uvs = read_buffer<Vector2<f32>>(file, record.uvs);
+            auto tangents = read_buffer<Vector4<f32>>(file, record.tangents);
+            auto indices = read_buffer<u32>(file, record.indices);
+            auto meshlets = read_buffer<Meshlet>(file, record.meshlets);
+            auto meshlet_vertices = read_buffer<u32>(file, record.meshlet_vertices);
+            auto meshlet_triangles = read_buffer<u8>(file, record.meshlet_triangles);
+
+            const auto lod_records = file->at<LodRecord>(record.lods.offset, record.lods.count);
+            if (record.lods.count != 0 && !lod_records) return std::nullopt;
+            std::vector<MeshLod> lods{};
+            for (usize l = 0; l < record.lods.count; l++) {
+                const auto& lod = lod_records[l];
+                auto lod_indices = read_buffer<u32>(file, lod.indices);
+                auto lod_meshlets = read_buffer<Meshlet>(file, lod.meshlets);
+                auto lod_meshlet_vertices = read_buffer<u32>(file, lod.meshlet_vertices);
+                auto lod_meshlet_triangles = read_buffer<u8>(file, lod.meshlet_triangles);
+                if (!lod_indices || !lod_meshlets || !lod_meshlet_vertices || !lod_meshlet_triangles) return std::nullopt;
+                lods.push_back(MeshLod{
+                    std::move(*lod_indices),
+                    Meshlets{std::move(*lod_meshlets), std::move(*lod_meshlet_vertices), std::move(*lod_meshlet_triangles)},
+                    lod.error,
+                });
+            }
+
+            const auto ambient = texture(record.material.ambient_map, [&](ref<std::string> path) { return resource_store.rgba_gamma_corrected(path); });
+            const auto diffuse = texture(record.material.diffuse_map, [&](ref<std::string> path) { return resource_store.rgba_gamma_corrected(path); });
+            const auto specular = texture(record.material.specular_map, [&](ref<std::string> path) { return resource_store.map(path); });
+            const auto normal = texture(record.material.normal_map, [&](ref<std::string> path) { return resource_store.normal_map(path); });
+            if (!name || !x || !y || !z || !normals || !uvs || !tangents || !indices || !meshlets || !meshlet_vertices || !meshlet_triangles || !ambient || !diffuse || !specular || !normal) return std::nullopt;
+
+            Material material{
+                record.material.ambient,
+                record.material.diffuse,
+                record.material.specular,
+                record.material.shininess,
+                *ambient,
+                *diffuse,
+                *specular,
+                *normal,
+            };
+
+            meshes.emplace_back(
+                *name,
+                Vertices{std::move(*x), std::move(*y), std::move(*z), std::move(*normals), std::move(*uvs), std::move(*tangents)},
+                std::move(*indices),
+                Meshlets{std::move(*meshlets), std::move(*meshlet_vertices), std::move(*meshlet_triangles)},
+                std::move(lods),
+                std::move(material),
+                Bounds{record.bounds_min, record.bounds_max}
+            );
+            std::cout << "Mesh " << meshes.back().name << " loaded with " << meshes.back().triangles() << " faces " << meshes.back().m_vertices.size() << " vertices" << "\n";
+        }
+        return meshes;
+    }
+
+    /**
+     * @param dependencies other files the meshes were built from, the cache goes stale when one of them changes
+     */
+    static void store(ref<std::string> source, ref<std::vector<std::string>> dependencies, ref<std::vector<Mesh>> meshes) {
+        const auto stamp = FileStamp::of(source);
+        if (!stamp) return;
+
+        BlobWriter writer{};
+        const auto header_offset = writer.reserve<Header>();
+
+        const auto dependencies_offset = writer.reserve<DependencyRecord>(dependencies.size());
+        for (usize i = 0; i < dependencies.size(); i++) {
+            const auto dependency_stamp = FileStamp::of(dependencies[i]);
+            if (!dependency_stamp) return;
+            writer.write(dependencies_offset + i*sizeof(DependencyRecord), DependencyRecord{
+                writer.append(dependencies[i]),
+                dependency_stamp->size,
+                dependency_stamp->mtime,
+            });
+        }
+
+        const auto records_offset = writer.reserve<MeshRecord>(meshes.size());
+
+        for (usize i = 0; i < meshes.size(); i++) {
+            const auto& mesh = meshes[i];
+            const auto& material = mesh.m_material;
+
+            const auto lods_offset = writer.reserve<LodRecord>(mesh.m_lods.size());
+            for (usize l = 0; l < mesh.m_lods.size(); l++) {
+                const auto& lod = mesh.m_lods[l];
+                const LodRecord lod_record{
+                    lod.error,
+                    writer.append(lod.indices.data(), lod.indices.size()),
+                    writer.append(lod.meshlets.meshlets.data(), lod.meshlets.meshlets.size()),
+                    writer.append(lod.meshlets.vertices.data(), lod.meshlets.vertices.size()),
+                    writer.append(lod.meshlets.triangles.data(), lod.meshlets.triangles.size()),
+                };
+                writer.write(lods_offset + l*sizeof(LodRecord), lod_record);
+            }
+
+            MeshRecord record{
+                writer.append(mesh.name),
+                MaterialRecord{
+                    material.ambient,
+                    material.diffuse,
+                    material.specular,
+                    material.shininess,
+                    append_texture(writer, material.ambient_map),
+                    append_texture(writer, material.diffuse_map),
+                    append_texture(writer, material.specular_map),
+                    append_texture(writer, material.normal_map),
+                },
+                mesh.m_bounds.min,
+                mesh.m_bounds.max,
+                writer.append(mesh.m_vertices.x.data(), mesh.m_vertices.x.size()),
+                writer.append(mesh.m_vertices.y.data(), mesh.m_vertices.y.size()),
+                writer.append(mesh.m_vertices.z.data(), mesh.m_vertices.z.size()),
+                writer.append(mesh.m_vertices.normals.data(), mesh.m_vertices.normals.size()),
+                writer.append(mesh.m_vertices.uvs.data(), mesh.m_vertices.uvs.size()),
+                writer.append(mesh.m_vertices.tangents.data(), mesh.m_vertices.tangents.size()),
+                writer.append(mesh.m_indices.data(), mesh.m_indices.size()),
+                writer.append(mesh.m_meshlets.meshlets.data(), mesh.m_meshlets.meshlets.size()),
+                writer.append(mesh.m_meshlets.vertices.data(), mesh.m_meshlets.vertices.size()),
+                writer.append(mesh.m_meshlets.triangles.data(), mesh.m_meshlets.triangles.size()),
+                BlobSpan{lods_offset, mesh.m_lods.size()},
+            };
+            writer.write(records_offset + i*sizeof(MeshRecord), record);
+        }
+
+        writer.write(header_offset, Header{
+            MAGIC,
+            VERSION,
+            stamp->size,
+            stamp->mtime,
+            BlobSpan{dependencies_offset, dependencies.size()},
+            BlobSpan{records_offset, meshes.size()},
+        });
+
+        if (!writer.save(path_for(source))) {
+            std::cout << "Failed to write mesh cache: " << path_for(source) << std::endl;
+        }
+    }
+};
+
+#endif //MESH_CACHE_H
@@ -0,0 +1,344 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include <util/types.h>
+#include <util/vec_math.h>
+
+/**
+ * Reorders the triangles and vertices of an indexed mesh so it renders faster, run once when a mesh is loaded.
+ *
+ * 1. triangles are ordered for post transform cache reuse with Tipsify (Sander, Nehab and Barczak 2007)
+ * 2. that order is split into clusters which are sorted so clusters facing away from the mesh center come first, reducing overdraw
+ * 3. vertices are renumbered in the order they are first used so vertex reads walk memory forwards
+ */
+class MeshOptimizer {
+public:
+    static constexpr u32 CACHE_SIZE = 16;
+    static constexpr f32 OVERDRAW_THRESHOLD = 1.05f;
+
+    /**
+     * Average cache miss ratio, the number of vertices a FIFO post transform cache would have to transform per triangle
+     */
+    [[nodiscard]]
+    static f32 acmr(ref<std::vector<u32>> indices, usize vertex_count, u32 cache_size = CACHE_SIZE) {
+        if (indices.empty()) return 0;
+        std::vector<u32> timestamps(vertex_count, 0);
+        u32 time = cache_size + 1;
+        usize misses = 0;
+        for (const auto index : indices) {
+            if (time - timestamps[index] > cache_size) {
+                timestamps[index] = time++;
+                misses++;
+            }
+        }
+        return static_cast<f32>(misses) / static_cast<f32>(indices.size() / 3);
+    }
+
+    /**
+     * Rasterizes the mesh with a depth test from the six axis directions in the given triangle order
+     * @return the average number of times a covered pixel was written
+     */
+    [[nodiscard]]
+    static f32 overdraw(ref<std::vector<u32>> indices, ref<std::vector<f32>> x, ref<std::vector<f32>> y, ref<std::vector<f32>> z) {
+        constexpr usize GRID = 256;
+        if (indices.empty()) return 0;
+
+        Vector3<f32> min{x[indices[0]], y[indices[0]], z[indices[0]]};
+        Vector3<f32> max = min;
+        for (const auto index : indices) {
+            const Vector3<f32> p{x[index], y[index], z[index]};
+            for (usize c = 0; c < 3; c++) {
+                min[c] = std::min(min[c], p[c]);
+                max[c] = std::max(max[c], p[c]);
+            }
+        }
+        const auto extent = std::max({max.x() - min.x(), max.y() - min.y(), max.z() - min.z(), 1e-12f});
+        const auto scale = static_cast<f32>(GRID - 1) / extent;
+
+        std::vector<f32> depth(GRID * GRID);
+        usize covered = 0, shaded = 0;
+        for (usize axis = 0; axis < 3; axis++) {
+            for (const auto flip : {1.f, -1.f}) {
+                std::fill(depth.begin(), depth.end(), std::numeric_limits<f32>::max());
+                for (usize t = 0; t < indices.size(); t += 3) {
+                    std::array<Vector3<f32>, 3> v{};
+                    for (usize c = 0; c < 3; c++) {
+                        const auto i = indices[t + c];
+                        const Vector3<f32> p{(x[i] - min.x()) * scale, (y[i] - min.y()) * scale, (z[i] - min.z()) * scale};
+                        // view down the axis, u and v span the other two axes
+                        v[c] = {p[(axis + 1) % 3] * flip, p[(axis + 2) % 3], p[axis] * flip};
+                        if (flip < 0) v[c].x() += static_cast<f32>(GRID - 1);
+                    }
+                    shaded += rasterize_depth(v, depth, GRID);
+                }
+                for (const auto d : depth) {
+                    covered += d != std::numeric_limits<f32>::max();
+                }
+            }
+        }
+        return covered == 0 ? 0 : static_cast<f32>(shaded) / static_cast<f32>(covered);
+    }
+
+    /**
+     * Reorders the triangles in place and renumbers the vertices they use
+     * @param result_overdraw set to the overdraw of the new order, renumbering vertices does not change it
+     * @return for every new vertex index the old vertex index it came from
+     */
+    [[nodiscard]]
+    static std::vector<u32> optimize(ref_mut<std::vector<u32>> indices, ref<std::vector<f32>> x, ref<std::vector<f32>> y, ref<std::vector<f32>> z, ref_mut<f32> result_overdraw) {
+        std::vector<u32> clusters{};
+        indices = tipsify(indices, x.size(), CACHE_SIZE, clusters);
+        // sorting by facing assumes outward winding and separate parts hiding each other can defeat it, so keep it only when it helps
+        auto sorted = sort_clusters(indices, x, y, z, clusters);
+        const auto sorted_overdraw = overdraw(sorted, x, y, z);
+        result_overdraw = overdraw(indices, x, y, z);
+        if (sorted_overdraw < result_overdraw) {
+            indices = std::move(sorted);
+            result_overdraw = sorted_overdraw;
+        }
+        return optimize_vertex_fetch(indices, x.size());
+    }
+
+private:
+    /**
+     * @return how many pixels passed the depth test
+     */
+    static usize rasterize_depth(ref<std::array<Vector3<f32>, 3>> v, ref_mut<std::vector<f32>> depth, usize grid) {
+        const auto area = (v[1].x() - v[0].x()) * (v[2].y() - v[0].y()) - (v[2].x() - v[0].x()) * (v[1].y() - v[0].y());
+        // only front faces, like the renderer
+        if (area <= 0) return 0;
+
+        const auto min_x = static_cast<isize>(std::max(0.f, std::ceil(std::min({v[0].x(), v[1].x(), v[2].x()}) - 0.5f)));
+        const auto max_x = static_cast<isize>(std::min(static_cast<f32>(grid - 1), std::floor(std::max({v[0].x(), v[1].x(), v[2].x()}) - 0.5f)));
+        const auto min_y = static_cast<isize>(std::max(0.f, std::ceil(std::min({v[0].y(), v[1].y(), v[2].y()}) - 0.5f)));
+        const auto max_y = static_cast<isize>(std::min(static_cast<f32>(grid - 1), std::floor(std::max({v[0].y(), v[1].y(), v[2].y()}) - 0.5f)));
+
+        usize passed = 0;
+        for (auto py = min_y; py <= max_y; py++) {
+            for (auto px = min_x; px <= max_x; px++) {
+                const auto sx = static_cast<f32>(px) + 0.5f;
+                const auto sy = static_cast<f32>(py) + 0.5f;
+                const auto w0 = (v[2].x() - v[1].x()) * (sy - v[1].y()) - (v[2].y() - v[1].y()) * (sx - v[1].x());
+                const auto w1 = (v[0].x() - v[2].x()) * (sy - v[2].y()) - (v[0].y() - v[2].y()) * (sx - v[2].x());
+                const auto w2 = area - w0 - w1;
+                if (w0 < 0 || w1 < 0 || w2 < 0) continue;
+
+                const auto d = (w0 * v[0].z() + w1 * v[1].z() + w2 * v[2].z()) / area;
+                auto& stored = depth[static_cast<usize>(px) + static_cast<usize>(py) * grid];
+                if (d < stored) {
+                    stored = d;
+                    passed++;
+                }
+            }
+        }
+        return passed;
+    }
+
+    /**
+     * Greedily fans around the most recently used vertices that will still be in the cache after their remaining triangles are emitted.
+     * The triangle index of every point where no such vertex was left and the cache effectively restarts is written to clusters.
+     */
+    [[nodiscard]]
+    static std::vector<u32> tipsify(ref<std::vector<u32>> indices, usize vertex_count, u32 cache_size, ref_mut<std::vector<u32>> clusters) {
+        const auto triangle_count = indices.size() / 3;
+
+        // vertex to triangle adjacency
+        std::vector<u32> live(vertex_count, 0);
+        for (const auto index : indices) live[index]++;
+        std::vector<u32> offsets(vertex_count + 1, 0);
+        for (usize v = 0; v < vertex_count; v++) offsets[v + 1] = offsets[v] + live[v];
+        std::vector<u32> adjacency(indices.size());
+        {
+            auto fill = offsets;
+            for (usize i = 0; i < indices.size(); i++) adjacency[fill[indices[i]]++] = static_cast<u32>(i / 3);
+        }
+
+        std::vector<u32> timestamps(vertex_count, 0);
+        std::vector<bool> emitted(triangle_count, false);
+        std::vector<u32> dead_end{};
+        std::vector<u32> candidates{};
+        std::vector<u32> result{};
+        result.reserve(indices.size());
+
+        u32 time = cache_size + 1;
+        usize cursor = 0;
+        isize fanning = vertex_count == 0 ? -1 : 0;
+        clusters.clear();
+        clusters.push_back(0);
+
+        while (fanning >= 0) {
+            candidates.clear();
+            for (auto a = offsets[fanning]; a < offsets[fanning + 1]; a++) {
+                const auto triangle = adjacency[a];
+                if (emitted[triangle]) continue;
+                for (usize c = 0; c < 3; c++) {
+                    const auto v = indices[triangle * 3 + c];
+                    result.push_back(v);
+                    dead_end.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+                    if (time - timestamps[v] > cache_size) {
+                        timestamps[v] = time++;
+                    }
+                }
+                emitted[triangle] = true;
+            }
+
+            // the next fanning vertex is the candidate used longest ago that will still be in the cache once its triangles are emitted
+            isize best = -1;
+            i64 best_priority = -1;
+            for (const auto v : candidates) {
+                if (live[v] == 0) continue;
+                i64 priority = 0;
+                if (time - timestamps[v] + 2 * live[v] <= cache_size) {
+                    priority = time - timestamps[v];
+                }
+                if (priority > best_priority) {
+                    best = v;
+                    best_priority = priority;
+                }
+            }
+
+            if (best == -1) {
+                while (!dead_end.empty() && best == -1) {
+                    const auto v = dead_end.back();
+                    dead_end.pop_back();
+                    if (live[v] > 0) best = v;
+                }
+                while (best == -1 && cursor < vertex_count) {
+                    if (live[cursor] > 0) best = static_cast<isize>(cursor);
+                    cursor++;
+                }
+                if (best != -1 && result.size() / 3 != clusters.back()) {
+                    clusters.push_back(static_cast<u32>(result.size() / 3));
+                }
+            }
+            fanning = best;
+        }
+        return result;
+    }
+
+    /**
+     * Splits the hard clusters further wherever the cache efficiency so far is already close to that of the whole cluster,
+     * then orders the clusters by how much they face away from the center of the mesh so front surfaces are drawn first.
+     */
+    [[nodiscard]]
+    static std::vector<u32> sort_clusters(
+        ref<std::vector<u32>> indices,
+        ref<std::vector<f32>> x, ref<std::vector<f32>> y, ref<std::vector<f32>> z,
+        ref<std::vector<u32>> hard_clusters
+        ) {
+        const auto triangle_count = static_cast<u32>(indices.size() / 3);
+        if (triangle_count == 0) return indices;
+
+        std::vector<u32> timestamps(x.size(), 0);
+        u32 time = CACHE_SIZE + 1;
+        const auto misses = [&](u32 triangle) {
+            u32 result = 0;
+            for (usize c = 0; c < 3; c++) {
+                const auto v = indices[triangle * 3 + c];
+                if (time - timestamps[v] > CACHE_SIZE) {
+                    timestamps[v] = time++;
+                    result++;
+                }
+            }
+            return result;
+        };
+        const auto flush = [&] { time += CACHE_SIZE + 1; };
+
+        std::vector<u32> clusters{};
+        for (usize h = 0; h < hard_clusters.size(); h++) {
+            const auto begin = hard_clusters[h];
+            const auto end = h + 1 < hard_clusters.size() ? hard_clusters[h + 1] : triangle_count;
+
+            flush();
+            u32 cluster_misses = 0;
+            for (auto t = begin; t < end; t++) cluster_misses += misses(t);
+            const auto cluster_acmr = static_cast<f32>(cluster_misses) / static_cast<f32>(end - begin);
+
+            flush();
+            clusters.push_back(begin);
+            u32 soft_misses = 0, soft_triangles = 0;
+            for (auto t = begin; t < end; t++) {
+                soft_misses += misses(t);
+                soft_triangles++;
+                if (t + 1 < end && static_cast<f32>(soft_misses) / static_cast<f32>(soft_triangles) <= cluster_acmr * OVERDRAW_THRESHOLD) {
+                    clusters.push_back(t + 1);
+                    soft_misses = 0;
+                    soft_triangles = 0;
+                    flush();
+                }
+            }
+        }
+
+        Vector3<f32> mesh_center{};
+        f32 mesh_area = 0;
+        std::vector<Vector3<f32>> centers(clusters.size()), normals(clusters.size());
+        for (usize c = 0; c < clusters.size(); c++) {
+            const auto begin = clusters[c];
+            const auto end = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+            Vector3<f32> center{}, normal{};
+            f32 area = 0;
+            for (auto t = begin; t < end; t++) {
+                const auto i0 = indices[t * 3], i1 = indices[t * 3 + 1], i2 = indices[t * 3 + 2];
+                const Vector3<f32> p0{x[i0], y[i0], z[i0]}, p1{x[i1], y[i1], z[i1]}, p2{x[i2], y[i2], z[i2]};
+                const auto cross = (p1 - p0).cross(p2 - p0);
+                const auto triangle_area = cross.magnitude();
+                center = center + (p0 + p1 + p2) * (triangle_area / 3.f);
+                normal = normal + cross;
+                area += triangle_area;
+            }
+            mesh_center = mesh_center + center;
+            mesh_area += area;
+            centers[c] = area > 0 ? center / area : center;
+            normals[c] = normal.magnitude_squared() > 0 ? normal.normalize() : normal;
+        }
+        if (mesh_area > 0) mesh_center = mesh_center / mesh_area;
+
+        std::vector<f32> sort_key(clusters.size());
+        for (usize c = 0; c < clusters.size(); c++) {
+            sort_key[c] = (centers[c] - mesh_center).dot(normals[c]);
+        }
+        std::vector<u32> order(clusters.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](u32 a, u32 b) { return sort_key[a] > sort_key[b]; });
+
+        std::vector<u32> result{};
+        result.reserve(indices.size());
+        for (const auto c : order) {
+            const auto begin = clusters[c];
+            const auto end = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+            result.insert(result.end(), indices.begin() + begin * 3, indices.begin() + end * 3);
+        }
+        return result;
+    }
+
+    /**
+     * Renumbers the vertices in the order the triangles first use them
+     * @return for every new vertex index the old vertex index it came from
+     */
+    [[nodiscard]]
+    static std::vector<u32> optimize_vertex_fetch(ref_mut<std::vector<u32>> indices, usize vertex_count) {
+        constexpr auto UNUSED = std::numeric_limits<u32>::max();
+        std::vector<u32> remap(vertex_count, UNUSED);
+        std::vector<u32> order{};
+        order.reserve(vertex_count);
+        for (auto& index : indices) {
+            if (remap[index] == UNUSED) {
+                remap[index] = static_cast<u32>(order.size());
+                order.push_back(index);
+            }
+            index = remap[index];
+        }
+        return order;
+    }
+};
+
+#endif //MESH_OPTIMIZER_H
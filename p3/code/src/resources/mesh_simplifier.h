@@ -0,0 +1,240 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <tuple>
+#include <vector>
+
+#include <util/buffer.h>
+#include <util/types.h>
+#include <util/vec_math.h>
+
+/**
+ * Reduces the triangle count of an indexed mesh by collapsing edges, cheapest first as measured by
+ * quadric error metrics (Garland and Heckbert 1997). A vertex is only ever collapsed onto one of its neighbours,
+ * so the simplified triangles index the same vertices as the original ones.
+ *
+ * Vertices on an open border or on an attribute seam, where several vertices share one position, never move,
+ * which keeps the outline and texture seams of the mesh intact.
+ */
+class MeshSimplifier {
+    /**
+     * Sum of squared distances to a set of planes, as the upper triangle of a symmetric 4x4 matrix
+     */
+    struct Quadric {
+        f64 aa, ab, ac, ad, bb, bc, bd, cc, cd, dd;
+
+        static Quadric plane(f64 a, f64 b, f64 c, f64 d) {
+            return {a*a, a*b, a*c, a*d, b*b, b*c, b*d, c*c, c*d, d*d};
+        }
+
+        Quadric& operator+=(ref<Quadric> other) {
+            aa += other.aa; ab += other.ab; ac += other.ac; ad += other.ad;
+            bb += other.bb; bc += other.bc; bd += other.bd;
+            cc += other.cc; cd += other.cd;
+            dd += other.dd;
+            return *this;
+        }
+
+        [[nodiscard]]
+        f64 error(ref<Vector3<f32>> p) const {
+            const f64 x = p.x(), y = p.y(), z = p.z();
+            return aa*x*x + 2*ab*x*y + 2*ac*x*z + 2*ad*x
+                + bb*y*y + 2*bc*y*z + 2*bd*y
+                + cc*z*z + 2*cd*z
+                + dd;
+        }
+    };
+
+    struct Collapse {
+        u32 from;
+        u32 to;
+        f64 cost;
+    };
+
+    [[nodiscard]]
+    static std::vector<u8> locked_vertices(ref<std::vector<u32>> indices, ref<Buffer<f32>> x, ref<Buffer<f32>> y, ref<Buffer<f32>> z) {
+        std::vector<u8> locked(x.size(), 0);
+
+        // sorting by position puts vertices that share one next to each other
+        std::vector<u32> order(x.size());
+        std::iota(order.begin(), order.end(), 0);
+        const auto key = [&](u32 v) { return std::tuple{x[v], y[v], z[v]}; };
+        std::sort(order.begin(), order.end(), [&](u32 lhs, u32 rhs) { return key(lhs) < key(rhs); });
+        for (usize i = 1; i < order.size(); i++) {
+            if (key(order[i - 1]) == key(order[i])) {
+                locked[order[i - 1]] = 1;
+                locked[order[i]] = 1;
+            }
+        }
+
+        // an edge that only one triangle uses is on a border
+        std::vector<u64> edges{};
+        edges.reserve(indices.size());
+        for (usize t = 0; t < indices.size(); t += 3) {
+            for (usize e = 0; e < 3; e++) {
+                const auto a = indices[t + e], b = indices[t + (e + 1) % 3];
+                edges.push_back(static_cast<u64>(std::min(a, b)) << 32 | std::max(a, b));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        for (usize i = 0; i < edges.size();) {
+            auto end = i + 1;
+            while (end < edges.size() && edges[end] == edges[i]) end++;
+            if (end - i == 1) {
+                locked[edges[i] >> 32] = 1;
+                locked[static_cast<u32>(edges[i])] = 1;
+            }
+            i = end;
+        }
+        return locked;
+    }
+
+public:
+    /**
+     * @param target_index_count stop once the mesh has at most this many indices
+     * @param max_error never collapse an edge whose error is larger than this distance
+     * @param error set to the largest error of any collapse made, a distance in the units of the positions
+     * @return the indices of the simplified triangles
+     */
+    [[nodiscard]]
+    static std::vector<u32> simplify(
+        ref<std::vector<u32>> indices,
+        ref<Buffer<f32>> x, ref<Buffer<f32>> y, ref<Buffer<f32>> z,
+        usize target_index_count, f32 max_error, ref_mut<f32> error
+        ) {
+        const auto vertex_count = x.size();
+        const auto position = [&](u32 v) { return Vector3<f32>{x[v], y[v], z[v]}; };
+        const auto locked = locked_vertices(indices, x, y, z);
+
+        std::vector<Quadric> quadrics(vertex_count, Quadric{});
+        for (usize t = 0; t < indices.size(); t += 3) {
+            const auto p0 = position(indices[t]);
+            const auto normal = (position(indices[t + 1]) - p0).cross(position(indices[t + 2]) - p0);
+            if (normal.magnitude_squared() <= 0) continue;
+            const auto n = normal.normalize();
+            const auto plane = Quadric::plane(n.x(), n.y(), n.z(), -n.dot(p0));
+            for (usize c = 0; c < 3; c++) {
+                quadrics[indices[t + c]] += plane;
+            }
+        }
+
+        std::vector<u32> result = indices;
+        const f64 max_cost = static_cast<f64>(max_error) * max_error;
+        f64 worst_cost = 0;
+
+        std::vector<u32> remap(vertex_count);
+        std::vector<u8> touched(vertex_count);
+        std::vector<u32> offsets(vertex_count + 1);
+        std::vector<u32> adjacent{};
+        std::vector<Collapse> collapses{};
+
+        while (result.size() > target_index_count) {
+            // vertex to triangle adjacency of the current triangles
+            std::fill(offsets.begin(), offsets.end(), 0);
+            for (const auto v : result) offsets[v + 1]++;
+            for (usize v = 0; v < vertex_count; v++) offsets[v + 1] += offsets[v];
+            adjacent.resize(result.size());
+            {
+                auto fill = offsets;
+                for (usize i = 0; i < result.size(); i++) {
+                    adjacent[fill[result[i]]++] = static_cast<u32>(i / 3);
+                }
+            }
+
+            // every edge once, in the cheaper of the directions it can be collapsed in
+            collapses.clear();
+            for (usize t = 0; t < result.size(); t += 3) {
+                for (usize e = 0; e < 3; e++) {
+                    const auto a = result[t + e], b = result[t + (e + 1) % 3];
+                    if (a > b || (locked[a] && locked[b])) continue;
+                    auto sum = quadrics[a];
+                    sum += quadrics[b];
+                    const auto a_to_b = locked[a] ? std::numeric_limits<f64>::max() : sum.error(position(b));
+                    const auto b_to_a = locked[b] ? std::numeric_limits<f64>::max() : sum.error(position(a));
+                    collapses.push_back(a_to_b <= b_to_a ? Collapse{a, b, a_to_b} : Collapse{b, a, b_to_a});
+                }
+            }
+
+            for (u32 v = 0; v < vertex_count; v++) remap[v] = v;
+            std::fill(touched.begin(), touched.end(), 0);
+            auto triangles_left = result.size() / 3;
+            const auto target_triangles = target_index_count / 3;
+            usize collapsed = 0;
+
+            // a collapse removes about two triangles, so about this many would reach the target. Collapses much more
+            // expensive than that wait for the next pass, by when cheaper ones blocked by their neighbours may be free.
+            const auto cheaper = [](ref<Collapse> lhs, ref<Collapse> rhs) { return lhs.cost < rhs.cost; };
+            const auto goal = (triangles_left - target_triangles) / 2;
+            auto pass_cost = max_cost;
+            if (goal < collapses.size()) {
+                std::nth_element(collapses.begin(), collapses.begin() + static_cast<isize>(goal), collapses.end(), cheaper);
+                pass_cost = std::min(max_cost, collapses[goal].cost * 1.5);
+            }
+            // only the collapses allowed in this pass need to be in order
+            const auto allowed = std::partition(collapses.begin(), collapses.end(), [&](ref<Collapse> collapse) { return collapse.cost <= pass_cost; });
+            std::sort(collapses.begin(), allowed, cheaper);
+
+            for (auto it = collapses.begin(); it != allowed; ++it) {
+                const auto& collapse = *it;
+                if (triangles_left <= target_triangles) break;
+                if (touched[collapse.from] || touched[collapse.to]) continue;
+
+                // moving from onto to must not flip any triangle that survives the collapse
+                const auto target = position(collapse.to);
+                bool flips = false;
+                usize removed = 0;
+                for (auto i = offsets[collapse.from]; i < offsets[collapse.from + 1] && !flips; i++) {
+                    const auto* triangle = &result[adjacent[i] * 3];
+                    if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+                        removed++;
+                        continue;
+                    }
+                    std::array<Vector3<f32>, 3> before{position(triangle[0]), position(triangle[1]), position(triangle[2])};
+                    auto after = before;
+                    for (usize c = 0; c < 3; c++) {
+                        if (triangle[c] == collapse.from) after[c] = target;
+                        // a neighbour moved earlier in this pass makes the check meaningless
+                        flips |= touched[triangle[c]] != 0;
+                    }
+                    const auto normal_before = (before[1] - before[0]).cross(before[2] - before[0]);
+                    const auto normal_after = (after[1] - after[0]).cross(after[2] - after[0]);
+                    // triangles that are already degenerate have no side to flip to
+                    flips |= normal_before.magnitude_squared() > 0 && normal_before.dot(normal_after) <= 0;
+                }
+                if (flips) continue;
+
+                // the ring around from stays put for the rest of the pass so later flip checks see true positions
+                for (auto i = offsets[collapse.from]; i < offsets[collapse.from + 1]; i++) {
+                    const auto* triangle = &result[adjacent[i] * 3];
+                    touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+                }
+                remap[collapse.from] = collapse.to;
+                quadrics[collapse.to] += quadrics[collapse.from];
+                worst_cost = std::max(worst_cost, collapse.cost);
+                triangles_left -= std::min(removed, triangles_left);
+                collapsed++;
+            }
+            if (collapsed == 0) break;
+
+            usize write = 0;
+            for (usize t = 0; t < result.size(); t += 3) {
+                const auto a = remap[result[t]], b = remap[result[t + 1]], c = remap[result[t + 2]];
+                if (a == b || b == c || a == c) continue;
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+            result.resize(write);
+        }
+
+        error = static_cast<f32>(std::sqrt(worst_cost));
+        return result;
+    }
+};
+
+#endif //MESH_SIMPLIFIER_H
@@ -0,0 +1,158 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <util/buffer.h>
+#include <util/types.h>
+#include <util/vec_math.h>
+
+/**
+ * A small cluster of triangles with its own vertex list, bounding sphere and normal cone, so it can be culled as a whole
+ */
+struct Meshlet {
+    static constexpr usize MAX_VERTICES = 64;
+    static constexpr usize MAX_TRIANGLES = 124;
+
+    u32 vertex_offset;
+    u32 vertex_count;
+    u32 triangle_offset;
+    u32 triangle_count;
+
+    Vector3<f32> center;
+    f32 radius;
+    Vector3<f32> cone_axis;
+    // sine of the cone's half angle, 1 when the triangles face too many directions for the cone to ever cull
+    f32 cone_cutoff;
+
+    /**
+     * @param eye the camera position in the same space as the meshlet
+     * @return true if every triangle faces away from the eye
+     */
+    [[nodiscard]]
+    INLINE bool back_facing(ref<Vector3<f32>> eye) const {
+        const auto to_center = center - eye;
+        return to_center.dot(cone_axis) >= cone_cutoff * to_center.magnitude() + radius;
+    }
+};
+
+/**
+ * The meshlets of a mesh. Each meshlet owns a range of vertices, indices into the mesh vertices,
+ * and a range of triangles, three byte sized indices into the meshlet's own vertex range.
+ */
+class Meshlets {
+public:
+    Buffer<Meshlet> meshlets{};
+    Buffer<u32> vertices{};
+    Buffer<u8> triangles{};
+
+    [[nodiscard]]
+    usize size() const {
+        return meshlets.size();
+    }
+
+    [[nodiscard]]
+    usize triangle_count() const {
+        return triangles.size() / 3;
+    }
+
+    /**
+     * Greedily groups consecutive triangles, so the triangles should already be ordered for vertex reuse
+     */
+    [[nodiscard]]
+    static Meshlets build(ref<Buffer<u32>> indices, ref<Buffer<f32>> x, ref<Buffer<f32>> y, ref<Buffer<f32>> z) {
+        constexpr u8 UNUSED = 0xFF;
+        std::vector<Meshlet> meshlets{};
+        std::vector<u32> meshlet_vertices{};
+        std::vector<u8> meshlet_triangles{};
+        std::vector<u8> local(x.size(), UNUSED);
+
+        Meshlet current{};
+        const auto finish = [&] {
+            if (current.triangle_count == 0) return;
+            bound(current, meshlet_vertices, meshlet_triangles, x, y, z);
+            meshlets.push_back(current);
+            for (usize i = 0; i < current.vertex_count; i++) {
+                local[meshlet_vertices[current.vertex_offset + i]] = UNUSED;
+            }
+            current = Meshlet{};
+            current.vertex_offset = static_cast<u32>(meshlet_vertices.size());
+            current.triangle_offset = static_cast<u32>(meshlet_triangles.size() / 3);
+        };
+
+        for (usize t = 0; t < indices.size(); t += 3) {
+            const auto added = (local[indices[t]] == UNUSED) + (local[indices[t + 1]] == UNUSED) + (local[indices[t + 2]] == UNUSED);
+            if (current.vertex_count + added > Meshlet::MAX_VERTICES || current.triangle_count == Meshlet::MAX_TRIANGLES) {
+                finish();
+            }
+            for (usize c = 0; c < 3; c++) {
+                auto& slot = local[indices[t + c]];
+                if (slot == UNUSED) {
+                    slot = static_cast<u8>(current.vertex_count++);
+                    meshlet_vertices.push_back(indices[t + c]);
+                }
+                meshlet_triangles.push_back(slot);
+            }
+            current.triangle_count++;
+        }
+        finish();
+
+        return Meshlets{std::move(meshlets), std::move(meshlet_vertices), std::move(meshlet_triangles)};
+    }
+
+private:
+    static void bound(
+        ref_mut<Meshlet> meshlet,
+        ref<std::vector<u32>> meshlet_vertices, ref<std::vector<u8>> meshlet_triangles,
+        ref<Buffer<f32>> x, ref<Buffer<f32>> y, ref<Buffer<f32>> z
+        ) {
+        const auto position = [&](u8 local) {
+            const auto i = meshlet_vertices[meshlet.vertex_offset + local];
+            return Vector3<f32>{x[i], y[i], z[i]};
+        };
+
+        Vector3<f32> min = position(0), max = position(0);
+        for (u32 i = 1; i < meshlet.vertex_count; i++) {
+            const auto p = position(static_cast<u8>(i));
+            for (usize c = 0; c < 3; c++) {
+                min[c] = std::min(min[c], p[c]);
+                max[c] = std::max(max[c], p[c]);
+            }
+        }
+        meshlet.center = (min + max) * 0.5f;
+        meshlet.radius = 0;
+        for (u32 i = 0; i < meshlet.vertex_count; i++) {
+            meshlet.radius = std::max(meshlet.radius, (position(static_cast<u8>(i)) - meshlet.center).magnitude());
+        }
+
+        std::vector<Vector3<f32>> normals{};
+        Vector3<f32> axis{};
+        for (u32 t = 0; t < meshlet.triangle_count; t++) {
+            const auto* triangle = &meshlet_triangles[(meshlet.triangle_offset + t) * 3];
+            const auto p0 = position(triangle[0]);
+            const auto normal = (position(triangle[1]) - p0).cross(position(triangle[2]) - p0);
+            // degenerate triangles are never drawn so they do not widen the cone
+            if (normal.magnitude_squared() <= 0) continue;
+            normals.push_back(normal.normalize());
+            axis = axis + normals.back();
+        }
+
+        meshlet.cone_axis = {0, 0, 0};
+        meshlet.cone_cutoff = 1;
+        if (normals.empty() || axis.magnitude_squared() <= 0) return;
+        axis = axis.normalize();
+
+        f32 min_dot = 1;
+        for (const auto& normal : normals) {
+            min_dot = std::min(min_dot, normal.dot(axis));
+        }
+        // past about 85 degrees the cone is so wide it would hardly ever cull
+        if (min_dot <= 0.1f) return;
+        meshlet.cone_axis = axis;
+        meshlet.cone_cutoff = std::sqrt(1 - min_dot * min_dot);
+    }
+};
+
+#endif //MESHLET_H
@@ -7,41 +7,101 @@
 #include <utility>
 #include <vector>
 #include <variant>
+#include <unordered_map>
 #include <algorithm>
+#include <sstream>
 
 #include <tiny_obj_loader.h>
 
+#include <resources/mesh.h>
+#include <resources/mesh_cache.h>
+#include <resources/mesh_optimizer.h>
+#include <resources/obj_parser.h>
 #include <resources/texture.h>
+#include <util/trace.h>
 #include <util/vec_math.h>
 #include <resources/resource_store.h>
 
-class Face {
-public:
-    std::array<Vector3<f32>, 3> points;
-    std::array<Vector3<f32>, 3> normals;
-    std::array<Vector2<f32>, 3> uvs;
-};
+/**
+ * Collects the triangles of one mesh, vertices with the same position, normal and uv index are only stored once
+ */
+class MeshBuilder {
+    struct Key {
+        i32 vertex;
+        i32 normal;
+        i32 texcoord;
+
+        friend bool operator==(ref<Key> lhs, ref<Key> rhs) {
+            return lhs.vertex == rhs.vertex && lhs.normal == rhs.normal && lhs.texcoord == rhs.texcoord;
+        }
+    };
+
+    struct KeyHash {
+        usize operator()(ref<Key> key) const {
+            auto hash = static_cast<u64>(static_cast<u32>(key.vertex)) * 0x9E3779B97F4A7C15ull;
+            hash ^= static_cast<u64>(static_cast<u32>(key.normal)) * 0xC2B2AE3D27D4EB4Full + (hash << 6) + (hash >> 2);
+            hash ^= static_cast<u64>(static_cast<u32>(key.texcoord)) * 0x165667B19E3779F9ull + (hash << 6) + (hash >> 2);
+            return hash;
+        }
+    };
 
-class Material {
-public:
-    Vector3<f32> ambient;
-    Vector3<f32> diffuse;
-    Vector3<f32> specular;
-    u32 shininess{0};
-    std::optional<std::shared_ptr<const Texture>> ambient_map;
-    std::optional<std::shared_ptr<const Texture>> diffuse_map;
-    std::optional<std::shared_ptr<const Texture>> specular_map;
-    std::optional<std::shared_ptr<const Texture>> normal_map;
-};
+    std::unordered_map<Key, u32, KeyHash> m_lookup{};
+    std::vector<f32> m_x{};
+    std::vector<f32> m_y{};
+    std::vector<f32> m_z{};
+    std::vector<Vector3<f32>> m_normals{};
+    std::vector<Vector2<f32>> m_uvs{};
+
+    template<typename T>
+    [[nodiscard]]
+    static std::vector<T> permute(ref<std::vector<T>> values, ref<std::vector<u32>> remap) {
+        std::vector<T> result(remap.size());
+        for (usize i = 0; i < remap.size(); i++) {
+            result[i] = values[remap[i]];
+        }
+        return result;
+    }
 
-class Mesh {
 public:
-    std::string name{};
-    std::vector<Face> m_faces{};
-    Material m_material{};
+    std::vector<u32> indices{};
+
+    void add(ref<ObjFile> obj, ref<ObjIndex> index) {
+        const Key key{index.vertex, index.normal, index.texcoord};
+        const auto [entry, inserted] = m_lookup.try_emplace(key, static_cast<u32>(m_x.size()));
+        if (inserted) {
+            const auto v = index.vertex, n = index.normal, t = index.texcoord;
+            m_x.push_back(obj.positions[3*v]);
+            m_y.push_back(obj.positions[3*v+1]);
+            m_z.push_back(obj.positions[3*v+2]);
+            m_normals.push_back(n < 0 ? Vector3<f32>{} : Vector3<f32>{obj.normals[3*n], obj.normals[3*n+1], obj.normals[3*n+2]});
+            m_uvs.push_back(t < 0 ? Vector2<f32>{} : Vector2<f32>{obj.texcoords[2*t], obj.texcoords[2*t+1]});
+        }
+        indices.push_back(entry->second);
+    }
 
-    Mesh(std::string name, std::vector<Face> faces, Material material) : name {std::move(name)}, m_faces{std::move(faces)}, m_material{std::move(material)} {}
-    Mesh()= default;
+    /**
+     * Reorders the triangles and vertices for rendering, see MeshOptimizer, and writes how the cache miss ratio and overdraw changed to log
+     */
+    void optimize(ref<std::string> name, ref_mut<std::ostream> log) {
+        const auto acmr = MeshOptimizer::acmr(indices, m_x.size());
+        const auto overdraw = MeshOptimizer::overdraw(indices, m_x, m_y, m_z);
+
+        f32 optimized_overdraw = 0;
+        const auto remap = MeshOptimizer::optimize(indices, m_x, m_y, m_z, optimized_overdraw);
+        m_x = permute(m_x, remap);
+        m_y = permute(m_y, remap);
+        m_z = permute(m_z, remap);
+        m_normals = permute(m_normals, remap);
+        m_uvs = permute(m_uvs, remap);
+
+        log << "Mesh " << name << " optimized, ACMR " << acmr << " -> " << MeshOptimizer::acmr(indices, m_x.size())
+            << " overdraw " << overdraw << " -> " << optimized_overdraw << "\n";
+    }
+
+    [[nodiscard]]
+    Vertices vertices() {
+        return Vertices{std::move(m_x), std::move(m_y), std::move(m_z), std::move(m_normals), std::move(m_uvs), {}};
+    }
 };
 
 class Object {
@@ -51,25 +111,28 @@ public:
     Vector3<f32> m_scale{1, 1, 1};
     std::variant<Mesh, std::vector<Object>> m_kind;
 
-    explicit Object(Mesh&& mesh) : m_kind{mesh} {}
-    explicit Object(std::vector<Object>&& children) : m_kind{children} {}
+    explicit Object(Mesh&& mesh) : m_kind{std::move(mesh)} {}
+    explicit Object(std::vector<Object>&& children) : m_kind{std::move(children)} {}
 
     explicit Object(int _cpp_par_);
 
+    /**
+     * Loads every mesh of an OBJ file, one per material. The result is cached next to the source while the resource store caches.
+     */
     static Object load(std::string&& path, ref_mut<ResourceStore> resource_store) {
+        TRACE_SCOPE("load_obj");
+        if (resource_store.caching()) {
+            if (auto cached = MeshCache::load(path, resource_store)) {
+                std::cout << "Loaded cached OBJ file: " << path << std::endl;
+                return from_meshes(std::move(*cached));
+            }
+        }
 
-        tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> objmaterials;
         std::string err;
-
         auto parent = std::filesystem::path(path).parent_path().string() + "/";
-        bool success = tinyobj::LoadObj(&attrib, &shapes, &objmaterials, &err,
-            path.c_str(),
-            parent.c_str(),
-            true);
+        auto obj = ObjFile::parse(path, parent, err);
 
-        if (!success) {
+        if (!obj) {
             std::cout << "Failed to load OBJ file '" << err << "': " << path << std::endl;
             return Object(Mesh{});
         }
@@ -77,9 +140,9 @@ public:
             std::cout << err << std::endl;
         }
 
-        std::vector<Mesh> meshes{};
-        meshes.emplace_back(Mesh{});
-        for (const auto& mat : objmaterials) {
+        std::vector<Material> materials{};
+        materials.emplace_back(Material{});
+        for (const auto& mat : obj->materials) {
 
             auto ambient = mat.ambient_texname.empty()
                 ? std::nullopt :
@@ -108,64 +171,61 @@ public:
                 normal,
             };
 
-            meshes.push_back(Mesh{
-                "",
-                {},
-                material,
-            });
+            materials.push_back(material);
         }
 
+        // triangles grouped by material, index 0 holds the ones without a material
+        std::vector<std::string> names(materials.size());
+        std::vector<std::vector<u32>> triangles(materials.size());
+        for (usize t = 0; t < obj->triangles(); t++) {
+            const auto idx = static_cast<usize>(obj->material_ids[t] + 1);
+            if (names[idx].empty()) {
+                names[idx] = obj->names[obj->name_ids[t]];
+            }
+            triangles[idx].push_back(static_cast<u32>(t));
+        }
 
-
-        for (const auto& mesh: shapes) {
-            if (mesh.mesh.indices.empty())continue;
-
-            for (usize i = 0; i < mesh.mesh.indices.size(); i += 3) {
-
-                const auto i0 = mesh.mesh.indices[i];
-                const auto i1 = mesh.mesh.indices[i + 1];
-                const auto i2 = mesh.mesh.indices[i + 2];
-
-                std::array<Vector3<f32>, 3> positions{
-                    Vector3<f32>{attrib.vertices[3*i0.vertex_index], attrib.vertices[3*i0.vertex_index+1], attrib.vertices[3*i0.vertex_index+2]},
-                    Vector3<f32>{attrib.vertices[3*i1.vertex_index], attrib.vertices[3*i1.vertex_index+1], attrib.vertices[3*i1.vertex_index+2]},
-                    Vector3<f32>{attrib.vertices[3*i2.vertex_index], attrib.vertices[3*i2.vertex_index+1], attrib.vertices[3*i2.vertex_index+2]}
-                };
-
-                std::array<Vector3<f32>, 3> normals{
-                    Vector3<f32>{attrib.normals[3*i0.normal_index], attrib.normals[3*i0.normal_index+1], attrib.normals[3*i0.normal_index+2]},
-                    Vector3<f32>{attrib.normals[3*i1.normal_index], attrib.normals[3*i1.normal_index+1], attrib.normals[3*i1.normal_index+2]},
-                    Vector3<f32>{attrib.normals[3*i2.normal_index], attrib.normals[3*i2.normal_index+1], attrib.normals[3*i2.normal_index+2]}
-                };
-                std::array<Vector2<f32>, 3> uvs{
-                    Vector2<f32>{attrib.texcoords[2*i0.texcoord_index], attrib.texcoords[2*i0.texcoord_index+1]},
-                    Vector2<f32>{attrib.texcoords[2*i1.texcoord_index], attrib.texcoords[2*i1.texcoord_index+1]},
-                    Vector2<f32>{attrib.texcoords[2*i2.texcoord_index], attrib.texcoords[2*i2.texcoord_index+1]}
-                };
-                auto idx = mesh.mesh.material_ids[i/3]+1;
-
-                meshes[idx].m_faces.push_back(Face{
-                    positions,
-                    normals,
-                    uvs,
-                });
-                if (meshes[idx].name.empty()) {
-                    meshes[idx].name = mesh.name;
+        // every material is built into its own mesh independently, logging is deferred to keep the output in order
+        std::vector<std::optional<Mesh>> built(materials.size());
+        std::vector<std::ostringstream> logs(materials.size());
+        #ifdef USE_OPEN_MP
+        #pragma omp parallel for schedule(dynamic)
+        #endif
+        for (usize i = 0; i < materials.size(); i++) {
+            if (triangles[i].empty()) continue;
+            MeshBuilder builder{};
+            for (const auto t : triangles[i]) {
+                for (usize corner = 0; corner < 3; corner++) {
+                    builder.add(*obj, obj->indices[t*3 + corner]);
                 }
             }
+            builder.optimize(names[i], logs[i]);
+            built[i].emplace(std::move(names[i]), builder.vertices(), std::move(builder.indices), std::move(materials[i]));
         }
 
-        meshes.erase(std::remove_if(meshes.begin(), meshes.end(), [](const auto& mesh) {
-            if (mesh.m_faces.empty()) return true;
-            std::cout << "Mesh " << mesh.name << " loaded with " << mesh.m_faces.size() << " faces" << "\n";
-            return false;
-        }), meshes.end());
+        std::vector<Mesh> meshes{};
+        for (usize i = 0; i < materials.size(); i++) {
+            if (!built[i]) continue;
+            meshes.push_back(std::move(*built[i]));
+            std::cout << logs[i].str();
+            std::cout << "Mesh " << meshes.back().name << " loaded with " << meshes.back().triangles() << " faces " << meshes.back().m_vertices.size() << " vertices" << "\n";
+            for (const auto& lod : meshes.back().m_lods) {
+                std::cout << "  level of detail with " << lod.indices.size() / 3 << " faces, error " << lod.error << "\n";
+            }
+        }
 
         if (meshes.empty()) {
             std::cout << "Failed to load OBJ file: " << path << std::endl;
             return Object(Mesh{});
         }
         std::cout << "Loaded OBJ file: " << path << std::endl;
+        if (resource_store.caching()) {
+            MeshCache::store(path, obj->material_libraries, meshes);
+        }
+        return from_meshes(std::move(meshes));
+    }
+
+    static Object from_meshes(std::vector<Mesh>&& meshes) {
         if (meshes.size() == 1) {
             return Object(std::move(meshes[0]));
         }
@@ -176,23 +236,6 @@ public:
         }
         return Object(std::move(children));
     }
-
-    [[nodiscard]]
-    Matrix4<f32> model() const {
-        const Matrix4<f32> rotation{Matrix3<f32>::rotation(m_rotation)};
-        const Matrix4<f32> scale{
-            m_scale.x(), 0, 0, 0,
-            0, m_scale.y(), 0, 0,
-            0, 0, m_scale.z(), 0,
-            0, 0, 0, 1
-        };
-        auto model = rotation*scale;
-        model[{0, 3}] = m_position.x();
-        model[{1, 3}] = m_position.y();
-        model[{2, 3}] = m_position.z();
-        model[{3, 3}] = 1;
-        return model;
-    }
 };
 
 #endif //OBJ_H
\ No newline at end of file
@@ -0,0 +1,363 @@
+#ifndef OBJ_PARSER_H
+#define OBJ_PARSER_H
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef USE_OPEN_MP
+#include <omp.h>
+#endif
+
+#include <tiny_obj_loader.h>
+
+#include <util/mapped_file.h>
+#include <util/types.h>
+
+/**
+ * The position, normal and texture coordinate of one face corner, -1 when the corner has no normal or texture coordinate
+ */
+struct ObjIndex {
+    i32 vertex;
+    i32 normal;
+    i32 texcoord;
+};
+
+/**
+ * The triangles of an OBJ file with their materials, polygons are split into triangle fans.
+ *
+ * The file is mapped and split into chunks on line boundaries which are parsed in parallel. A first pass counts the
+ * vertex attributes of every chunk so the second pass can write them straight to their final place and resolve
+ * relative indices, the triangles of the chunks are then joined in file order.
+ */
+class ObjFile {
+    static constexpr usize MIN_CHUNK_SIZE = 1 << 20;
+
+    /**
+     * The material and name faces are given until the next usemtl, o or g line, -1 for ones carried over from the previous chunk
+     */
+    struct Run {
+        i32 material;
+        i32 name;
+    };
+
+    struct Chunk {
+        ptr<char> begin;
+        ptr<char> end;
+        usize positions{0};
+        usize normals{0};
+        usize texcoords{0};
+        usize position_base{0};
+        usize normal_base{0};
+        usize texcoord_base{0};
+
+        std::vector<ObjIndex> indices{};
+        std::vector<u32> runs{};
+        std::vector<Run> run_list{{-1, -1}};
+        std::vector<std::string> materials{};
+        std::vector<std::string> names{};
+        std::vector<std::string> mtllibs{};
+        std::string error{};
+    };
+
+public:
+    // three components per vertex
+    std::vector<f32> positions{};
+    // three components per vertex
+    std::vector<f32> normals{};
+    // two components per vertex
+    std::vector<f32> texcoords{};
+    // three per triangle
+    std::vector<ObjIndex> indices{};
+    // per triangle, -1 for triangles without a material
+    std::vector<i32> material_ids{};
+    // per triangle, the object or group the triangle is in
+    std::vector<u32> name_ids{};
+    std::vector<std::string> names{};
+    std::vector<tinyobj::material_t> materials{};
+    // paths of the material libraries the materials were read from
+    std::vector<std::string> material_libraries{};
+
+    [[nodiscard]]
+    usize triangles() const {
+        return material_ids.size();
+    }
+
+    /**
+     * @param mtl_dir the directory material libraries are loaded relative to
+     * @param err receives warnings, and the reason when parsing fails
+     */
+    [[nodiscard]]
+    static std::optional<ObjFile> parse(ref<std::string> path, ref<std::string> mtl_dir, ref_mut<std::string> err) {
+        const auto file = MappedFile::open(path);
+        if (!file) {
+            err = "Cannot open file [" + path + "]\n";
+            return std::nullopt;
+        }
+        const auto text = file->at<char>(0, file->size());
+        const auto size = file->size();
+
+        usize threads = 1;
+        #ifdef USE_OPEN_MP
+        threads = static_cast<usize>(omp_get_max_threads());
+        #endif
+        const auto chunk_count = std::clamp<usize>(size / MIN_CHUNK_SIZE, 1, threads * 8);
+
+        std::vector<Chunk> chunks(chunk_count);
+        for (usize i = 0; i < chunk_count; i++) {
+            chunks[i].begin = i == 0 ? text : chunks[i - 1].end;
+            chunks[i].end = i + 1 == chunk_count ? text + size : next_line(std::max(chunks[i].begin, text + size * (i + 1) / chunk_count), text + size);
+        }
+
+        #ifdef USE_OPEN_MP
+        #pragma omp parallel for schedule(dynamic)
+        #endif
+        for (usize i = 0; i < chunk_count; i++) {
+            count(chunks[i]);
+        }
+
+        ObjFile obj{};
+        usize positions = 0, normals = 0, texcoords = 0;
+        for (auto& chunk : chunks) {
+            chunk.position_base = positions;
+            chunk.normal_base = normals;
+            chunk.texcoord_base = texcoords;
+            positions += chunk.positions;
+            normals += chunk.normals;
+            texcoords += chunk.texcoords;
+        }
+        obj.positions.resize(positions * 3);
+        obj.normals.resize(normals * 3);
+        obj.texcoords.resize(texcoords * 2);
+
+        #ifdef USE_OPEN_MP
+        #pragma omp parallel for schedule(dynamic)
+        #endif
+        for (usize i = 0; i < chunk_count; i++) {
+            parse(chunks[i], obj, positions, normals, texcoords);
+        }
+
+        for (const auto& chunk : chunks) {
+            if (!chunk.error.empty()) {
+                err = chunk.error;
+                return std::nullopt;
+            }
+        }
+
+        std::map<std::string, int> material_map{};
+        for (const auto& chunk : chunks) {
+            for (const auto& mtllib : chunk.mtllibs) {
+                load_materials(mtllib, mtl_dir, obj.materials, material_map, obj.material_libraries, err);
+            }
+        }
+
+        // resolve material and name runs in file order, each chunk starts with the state the previous one ended in
+        std::vector<std::vector<Run>> resolved(chunk_count);
+        Run current{-1, 0};
+        obj.names.emplace_back();
+        for (usize i = 0; i < chunk_count; i++) {
+            const auto& chunk = chunks[i];
+            const auto name_base = static_cast<i32>(obj.names.size());
+            obj.names.insert(obj.names.end(), chunk.names.begin(), chunk.names.end());
+            for (const auto& run : chunk.run_list) {
+                if (run.material >= 0) {
+                    const auto found = material_map.find(chunk.materials[run.material]);
+                    current.material = found == material_map.end() ? -1 : found->second;
+                }
+                if (run.name >= 0) {
+                    current.name = name_base + run.name;
+                }
+                resolved[i].push_back(current);
+            }
+        }
+
+        std::vector<usize> triangle_base(chunk_count + 1, 0);
+        for (usize i = 0; i < chunk_count; i++) {
+            triangle_base[i + 1] = triangle_base[i] + chunks[i].runs.size();
+        }
+        obj.indices.resize(triangle_base.back() * 3);
+        obj.material_ids.resize(triangle_base.back());
+        obj.name_ids.resize(triangle_base.back());
+
+        #ifdef USE_OPEN_MP
+        #pragma omp parallel for schedule(dynamic)
+        #endif
+        for (usize i = 0; i < chunk_count; i++) {
+            const auto& chunk = chunks[i];
+            std::copy(chunk.indices.begin(), chunk.indices.end(), obj.indices.begin() + static_cast<isize>(triangle_base[i] * 3));
+            for (usize t = 0; t < chunk.runs.size(); t++) {
+                const auto& run = resolved[i][chunk.runs[t]];
+                obj.material_ids[triangle_base[i] + t] = run.material;
+                obj.name_ids[triangle_base[i] + t] = static_cast<u32>(run.name);
+            }
+        }
+
+        return obj;
+    }
+
+private:
+    [[nodiscard]]
+    static ptr<char> next_line(ptr<char> at, ptr<char> end) {
+        const auto newline = static_cast<ptr<char>>(std::memchr(at, '\n', static_cast<usize>(end - at)));
+        return newline ? newline + 1 : end;
+    }
+
+    [[nodiscard]]
+    static ptr<char> skip_space(ptr<char> at, ptr<char> end) {
+        while (at < end && (*at == ' ' || *at == '\t')) at++;
+        return at;
+    }
+
+    [[nodiscard]]
+    static bool keyword(ptr<char> at, ptr<char> end, ref<std::string_view> word) {
+        const auto len = word.size();
+        return static_cast<usize>(end - at) > len
+            && std::memcmp(at, word.data(), len) == 0
+            && (at[len] == ' ' || at[len] == '\t');
+    }
+
+    static f32 parse_float(ptr<char>& at, ptr<char> end) {
+        at = skip_space(at, end);
+        if (at < end && *at == '+') at++;
+        f32 value = 0;
+        const auto result = std::from_chars(at, end, value);
+        if (result.ec != std::errc{}) {
+            value = 0;
+        }
+        at = result.ptr;
+        while (at < end && *at != ' ' && *at != '\t') at++;
+        return value;
+    }
+
+    [[nodiscard]]
+    static std::string parse_word(ptr<char> at, ptr<char> end) {
+        at = skip_space(at, end);
+        auto word_end = at;
+        while (word_end < end && *word_end != ' ' && *word_end != '\t') word_end++;
+        return {at, word_end};
+    }
+
+    /**
+     * Resolves one component of a face corner, positive indices count from one and negative ones back from the last attribute read
+     * @return false if the index is not a number, is 0, or does not name an existing attribute
+     */
+    static bool parse_index(ptr<char>& at, ptr<char> end, usize read, usize total, ref_mut<i32> index) {
+        i32 raw = 0;
+        const auto result = std::from_chars(at, end, raw);
+        at = result.ptr;
+        if (result.ec != std::errc{} || raw == 0) {
+            return false;
+        }
+        const auto resolved = raw > 0 ? static_cast<i64>(raw) - 1 : static_cast<i64>(read) + raw;
+        index = static_cast<i32>(resolved);
+        return resolved >= 0 && static_cast<usize>(resolved) < total;
+    }
+
+    static void count(ref_mut<Chunk> chunk) {
+        for (auto line = chunk.begin; line < chunk.end; line = next_line(line, chunk.end)) {
+            const auto at = skip_space(line, chunk.end);
+            if (chunk.end - at < 2 || at[0] != 'v') continue;
+            if (at[1] == ' ' || at[1] == '\t') {
+                chunk.positions++;
+            } else if (chunk.end - at > 2 && (at[2] == ' ' || at[2] == '\t')) {
+                chunk.normals += at[1] == 'n';
+                chunk.texcoords += at[1] == 't';
+            }
+        }
+    }
+
+    static void parse(ref_mut<Chunk> chunk, ref_mut<ObjFile> obj, usize positions, usize normals, usize texcoords) {
+        auto position = chunk.position_base;
+        auto normal = chunk.normal_base;
+        auto texcoord = chunk.texcoord_base;
+        std::vector<ObjIndex> corners{};
+
+        for (auto line = chunk.begin; line < chunk.end; line = next_line(line, chunk.end)) {
+            auto end = static_cast<ptr<char>>(std::memchr(line, '\n', static_cast<usize>(chunk.end - line)));
+            if (!end) end = chunk.end;
+            if (end > line && end[-1] == '\r') end--;
+            auto at = skip_space(line, end);
+            if (at == end || *at == '#') continue;
+
+            if (keyword(at, end, "v")) {
+                at += 1;
+                for (usize c = 0; c < 3; c++) obj.positions[position * 3 + c] = parse_float(at, end);
+                position++;
+            } else if (keyword(at, end, "vn")) {
+                at += 2;
+                for (usize c = 0; c < 3; c++) obj.normals[normal * 3 + c] = parse_float(at, end);
+                normal++;
+            } else if (keyword(at, end, "vt")) {
+                at += 2;
+                for (usize c = 0; c < 2; c++) obj.texcoords[texcoord * 2 + c] = parse_float(at, end);
+                texcoord++;
+            } else if (keyword(at, end, "f")) {
+                at += 1;
+                corners.clear();
+                for (at = skip_space(at, end); at < end; at = skip_space(at, end)) {
+                    ObjIndex corner{-1, -1, -1};
+                    bool valid = parse_index(at, end, position, positions, corner.vertex);
+                    if (at < end && *at == '/') {
+                        at++;
+                        if (at < end && *at != '/') valid &= parse_index(at, end, texcoord, texcoords, corner.texcoord);
+                        if (at < end && *at == '/') {
+                            at++;
+                            valid &= parse_index(at, end, normal, normals, corner.normal);
+                        }
+                    }
+                    if (!valid) {
+                        chunk.error = "Face references a missing vertex: " + std::string(line, end) + "\n";
+                        return;
+                    }
+                    corners.push_back(corner);
+                    while (at < end && *at != ' ' && *at != '\t') at++;
+                }
+                for (usize k = 2; k < corners.size(); k++) {
+                    chunk.indices.push_back(corners[0]);
+                    chunk.indices.push_back(corners[k - 1]);
+                    chunk.indices.push_back(corners[k]);
+                    chunk.runs.push_back(static_cast<u32>(chunk.run_list.size() - 1));
+                }
+            } else if (keyword(at, end, "usemtl")) {
+                chunk.materials.push_back(parse_word(at + 6, end));
+                chunk.run_list.push_back({static_cast<i32>(chunk.materials.size() - 1), chunk.run_list.back().name});
+            } else if (keyword(at, end, "mtllib")) {
+                chunk.mtllibs.emplace_back(skip_space(at + 6, end), end);
+            } else if (keyword(at, end, "o") || keyword(at, end, "g")) {
+                chunk.names.push_back(parse_word(at + 1, end));
+                chunk.run_list.push_back({chunk.run_list.back().material, static_cast<i32>(chunk.names.size() - 1)});
+            }
+        }
+    }
+
+    /**
+     * Loads the first material library of an mtllib line that can be read, like tinyobj
+     */
+    static void load_materials(
+        ref<std::string> mtllib, ref<std::string> mtl_dir,
+        ref_mut<std::vector<tinyobj::material_t>> materials, ref_mut<std::map<std::string, int>> material_map,
+        ref_mut<std::vector<std::string>> libraries, ref_mut<std::string> err
+        ) {
+        tinyobj::MaterialFileReader reader(mtl_dir);
+        std::istringstream filenames(mtllib);
+        std::string filename;
+        while (filenames >> filename) {
+            std::string warning;
+            const auto ok = reader(filename, &materials, &material_map, &warning);
+            err += warning;
+            if (ok) {
+                libraries.push_back(mtl_dir + filename);
+                return;
+            }
+        }
+        err += "WARN: Failed to load material file(s). Use default material.\n";
+    }
+};
+
+#endif //OBJ_PARSER_H
@@ -1,155 +1,185 @@
 #ifndef RESOURCE_STORE_H
 #define RESOURCE_STORE_H
 
+#include <filesystem>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <vector>
 
 #include <resources/texture.h>
+#include <resources/texture_cache.h>
+#include <util/background_jobs.h>
+#include <util/trace.h>
 
 /**
- * Stores already loaded textures to prevent loading the same textures multiple times and also allow us to get a texture from a texture_id
+ * Stores already loaded textures to prevent loading the same textures multiple times and also allow us to get a texture from a texture_id.
+ *
+ * Textures are decoded by background jobs. Until a texture is decoded it is a 1x1 placeholder, the same one used for textures that
+ * fail to load, and the decoded texels replace the placeholder's when the jobs are polled. Textures may be requested from any thread,
+ * but textures are only registered under their id, and so only visible to the renderer, on the polling thread.
  */
 class ResourceStore {
     std::vector<std::shared_ptr<const Texture>> textures{};
-    std::map<std::string, std::shared_ptr<const Texture>> textures_map{};
+    std::map<std::string, std::shared_ptr<Texture>> textures_map{};
+    std::shared_ptr<const TextureCache> cache{};
+    usize next_id{1};
+    std::mutex mutex{};
+    std::unique_ptr<BackgroundJobs> jobs;
     friend class Texture;
 
-public:
-    ResourceStore() = default;
-
-    std::shared_ptr<const Texture> normal_map(ref<std::string> path) {
-        if (textures_map.count(path) != 0) {
-            return textures_map[path];
+    [[nodiscard]]
+    static std::string_view kind_name(TextureKind kind) {
+        switch (kind) {
+            case TextureKind::Map:
+                return "map";
+            case TextureKind::Normal:
+                return "normal map";
+            case TextureKind::GammaCorrected:
+                return "rgba gamma corrected";
         }
+        return "";
+    }
 
-        i32 width, height, channels;
-        auto result = stbi_load(path.c_str(), &width, &height, &channels, 4);
-
-        if (!result)
-            std::cout << "Failed to load texture: " << path << std::endl;
-        if (width == 0)
-            std::cout << "Texture width cannot be zero: " << path << std::endl;
-        if (height == 0)
-            std::cout << "Texture height cannot be zero: " << path << std::endl;
-
-        std::shared_ptr<Texture> shared;
-        if (!result || width == 0 || height == 0) {
-            Texture texture{1, 1, false, new Vector4<f32>[1]};
-            texture.m_pixels[0] = {0, 0, 1.};
-
-            shared = std::make_shared<Texture>(std::move(texture));
-        }else{
-            auto w = static_cast<usize>(width);
-            auto h = static_cast<usize>(height);
-            Texture texture{w, h, false, new Vector4<f32>[w*h]};
-
-            for (usize i = 0; i < w*h; i++) {
-                texture.m_pixels[i] = {result[i*4]/255.f*2-1, result[i*4+1]/255.f*2-1, result[i*4+2]/255.f*2-1, result[i*4+3]/255.f*2-1};
-                texture.m_transparent |= result[i*4+3] != 1.;
-            }
-
-            std::cout << "Loaded normal map texture: " << path << " width: " << texture.width() << " height: " << texture.height() << " transparent: " << texture.transparent() << std::endl;
-
-            shared = std::make_shared<Texture>(std::move(texture));
-        }
-
-        stbi_image_free(result);
-
-        shared->m_id = TextureId(textures.size()+1);
-        textures_map[path] = shared;
-        textures.emplace_back(textures_map[path]);
-
-        return shared;
+    [[nodiscard]]
+    static Texture placeholder() {
+        static constexpr u8 missing[4] = {0, 0, 255, 0};
+        return Texture{1, 1, false, TextureKind::Map, missing, nullptr};
     }
 
-    std::shared_ptr<const Texture> map(ref<std::string> path) {
-        if (textures_map.count(path) != 0) {
-            return textures_map[path];
+    /**
+     * Reads a texture from the cache or decodes it from its source, runs on a background job
+     */
+    [[nodiscard]]
+    static Texture decode(ref<std::string> path, TextureKind kind, ptr<TextureCache> cache) {
+        TRACE_SCOPE("decode_texture");
+        std::ostringstream log;
+        if (auto cached = cache ? cache->load(path, kind) : std::nullopt) {
+            log << "Loaded cached " << kind_name(kind) << " texture: " << path << " width: " << cached->width() << " height: " << cached->height() << " transparent: " << cached->transparent() << "\n";
+            std::cout << log.str() << std::flush;
+            return std::move(*cached);
         }
 
         i32 width, height, channels;
         auto result = stbi_load(path.c_str(), &width, &height, &channels, 4);
 
         if (!result)
-            std::cout << "Failed to load texture: " << path << std::endl;
+            log << "Failed to load texture: " << path << "\n";
         if (width == 0)
-            std::cout << "Texture width cannot be zero: " << path << std::endl;
+            log << "Texture width cannot be zero: " << path << "\n";
         if (height == 0)
-            std::cout << "Texture height cannot be zero: " << path << std::endl;
+            log << "Texture height cannot be zero: " << path << "\n";
 
-        std::shared_ptr<Texture> shared;
         if (!result || width == 0 || height == 0) {
-            Texture texture{1, 1, false, new Vector4<f32>[1]};
-            texture.m_pixels[0] = {0, 0, 1.};
+            stbi_image_free(result);
+            std::cout << log.str() << std::flush;
+            return placeholder();
+        }
 
-            shared = std::make_shared<Texture>(std::move(texture));
-        }else{
-            auto w = static_cast<usize>(width);
-            auto h = static_cast<usize>(height);
-            Texture texture{w, h, false, new Vector4<f32>[w*h]};
+        auto w = static_cast<usize>(width);
+        auto h = static_cast<usize>(height);
+        Texture texture{w, h, Texture::any_transparent(result, w*h), kind, result, std::shared_ptr<const u8>(result, stbi_image_free)};
 
-            for (usize i = 0; i < w*h; i++) {
-                texture.m_pixels[i] = {result[i*4]/255.f, result[i*4+1]/255.f, result[i*4+2]/255.f, result[i*4+3]/255.f};
-                texture.m_transparent |= result[i*4+3] != 1.;
-            }
+        log << "Loaded " << kind_name(kind) << " texture: " << path << " width: " << texture.width() << " height: " << texture.height() << " transparent: " << texture.transparent() << "\n";
+        std::cout << log.str() << std::flush;
 
-            std::cout << "Loaded map texture: " << path << " width: " << texture.width() << " height: " << texture.height() << " transparent: " << texture.transparent() << std::endl;
+        if (cache) cache->store(path, texture);
+        return texture;
+    }
 
-            shared = std::make_shared<Texture>(std::move(texture));
+    std::shared_ptr<const Texture> load(ref<std::string> path, TextureKind kind) {
+        std::lock_guard lock{mutex};
+        if (const auto found = textures_map.find(path); found != textures_map.end()) {
+            return found->second;
         }
 
-        stbi_image_free(result);
-
-        shared->m_id = TextureId(textures.size()+1);
+        auto shared = std::make_shared<Texture>(placeholder());
+        shared->m_path = path;
+        shared->m_id = TextureId(next_id++);
         textures_map[path] = shared;
-        textures.emplace_back(textures_map[path]);
 
+        jobs->post([this, shared] {
+            const auto index = shared->get_id().id - 1;
+            if (textures.size() <= index) textures.resize(index + 1);
+            textures[index] = shared;
+        });
+        jobs->submit(
+            [path, kind, cache = cache] { return decode(path, kind, cache.get()); },
+            [shared](Texture&& texture) { shared->replace_texels(std::move(texture)); }
+        );
         return shared;
     }
 
-    std::shared_ptr<const Texture> rgba_gamma_corrected(ref<std::string> path) {
-        if (textures_map.count(path) != 0) {
-            return textures_map[path];
-        }
-
-        i32 width, height, channels;
-        auto result = stbi_loadf(path.c_str(), &width, &height, &channels, 4);
-
-        if (!result)
-            std::cout << "Failed to load texture: " << path << std::endl;
-        if (width == 0)
-            std::cout << "Texture width cannot be zero: " << path << std::endl;
-        if (height == 0)
-            std::cout << "Texture height cannot be zero: " << path << std::endl;
+public:
+    /**
+     * @param loader_threads how many threads load in the background, with none everything loads before it is returned
+     */
+    explicit ResourceStore(usize loader_threads = 0) : jobs(std::make_unique<BackgroundJobs>(loader_threads)) {}
+
+    /**
+     * Only valid before anything is loaded, pending loads refer back to the store that started them
+     */
+    ResourceStore(ResourceStore&& other) noexcept :
+        textures(std::move(other.textures)), textures_map(std::move(other.textures_map)), cache(std::move(other.cache)),
+        next_id(other.next_id), jobs(std::move(other.jobs)) {}
+
+    /**
+     * @param cache_dir where decoded textures are cached between runs
+     */
+    ResourceStore(std::filesystem::path cache_dir, usize loader_threads) : ResourceStore(loader_threads) {
+        cache = std::make_shared<const TextureCache>(std::move(cache_dir));
+    }
 
-        std::shared_ptr<Texture> shared;
-        if (!result || width == 0 || height == 0) {
-            Texture texture{1, 1, false, new Vector4<f32>[1]};
-            texture.m_pixels[0] = {0, 0, 1.};
+    /**
+     * @return if loaded resources are cached between runs
+     */
+    [[nodiscard]]
+    bool caching() const {
+        return cache != nullptr;
+    }
 
-            shared = std::make_shared<Texture>(std::move(texture));
-        }else{
-            auto w = static_cast<usize>(width);
-            auto h = static_cast<usize>(height);
-            Texture texture{w, h, false, new Vector4<f32>[w*h]};
+    /**
+     * Runs work in the background like a texture load, its result is passed to publish once the store is polled
+     */
+    template<typename Work, typename Publish>
+    void spawn(Work&& work, Publish&& publish) {
+        jobs->submit(std::forward<Work>(work), std::forward<Publish>(publish));
+    }
 
-            for (usize i = 0; i < w*h; i++) {
-                texture.m_pixels[i] = {result[i*4], result[i*4+1], result[i*4+2], result[i*4+3]};
-                texture.m_transparent |= result[i*4+3] != 1.f;
-            }
+    /**
+     * Publishes everything loaded since the last poll, swapping decoded textures in for their placeholders
+     * @return how many loads were published
+     */
+    usize poll() {
+        return jobs->poll();
+    }
 
-            std::cout << "Loaded rgba gamma corrected texture: " << path << " width: " << texture.width() << " height: " << texture.height() << " transparent: " << texture.transparent() << std::endl;
+    /**
+     * Blocks until everything requested so far has loaded and is published
+     */
+    void wait() {
+        jobs->wait();
+    }
 
-            shared = std::make_shared<Texture>(std::move(texture));
-        }
+    /**
+     * @return how many loads have not been published yet
+     */
+    [[nodiscard]]
+    usize loading() const {
+        return jobs->pending();
+    }
 
-        stbi_image_free(result);
+    std::shared_ptr<const Texture> normal_map(ref<std::string> path) {
+        return load(path, TextureKind::Normal);
+    }
 
-        shared->m_id = TextureId(textures.size()+1);
-        textures_map[path] = shared;
-        textures.emplace_back(textures_map[path]);
+    std::shared_ptr<const Texture> map(ref<std::string> path) {
+        return load(path, TextureKind::Map);
+    }
 
-        return shared;
+    std::shared_ptr<const Texture> rgba_gamma_corrected(ref<std::string> path) {
+        return load(path, TextureKind::GammaCorrected);
     }
 
     std::shared_ptr<const Texture> rgba(ref<std::string> path) {
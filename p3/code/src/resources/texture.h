@@ -1,6 +1,9 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include <memory>
+#include <string>
+
 #include <stb_image.h>
 
 #include <util/types.h>
@@ -28,8 +31,44 @@ public:
     }
 };
 
+enum class TextureKind : u32 {
+    /// channels are mapped linearly into [0.0f, 1.0f]
+    Map = 0,
+    /// channels are mapped into [-1.0f, 1.0f]
+    Normal = 1,
+    /// color channels are linearized with a 2.2 gamma, alpha is mapped linearly into [0.0f, 1.0f]
+    GammaCorrected = 2,
+};
+
 /**
- * A texture with 4 channels each in the range [0.0f, 1.0f]
+ * Lookup tables converting the 8 bit channels of a texel into the values a texture kind is sampled as
+ */
+struct TexelDecode {
+    std::array<f32, 256> color;
+    std::array<f32, 256> alpha;
+
+    [[nodiscard]]
+    static ref<TexelDecode> of(TextureKind kind) {
+        static const std::array<TexelDecode, 3> decoders = [] {
+            std::array<TexelDecode, 3> decoders{};
+            for (usize i = 0; i < 256; i++) {
+                const auto linear = static_cast<f32>(i) / 255.f;
+                decoders[0].color[i] = linear;
+                decoders[0].alpha[i] = linear;
+                decoders[1].color[i] = linear * 2 - 1;
+                decoders[1].alpha[i] = linear * 2 - 1;
+                decoders[2].color[i] = std::pow(linear, 2.2f);
+                decoders[2].alpha[i] = linear;
+            }
+            return decoders;
+        }();
+        return decoders[static_cast<u32>(kind)];
+    }
+};
+
+/**
+ * A texture with 4 channels stored as 8 bit RGBA, decoded into floats according to its kind when sampled.
+ * The texels are either owned by the texture or live inside a mapped cache file.
  */
 class Texture {
     usize m_width;
@@ -37,27 +76,45 @@ class Texture {
     f32 m_widthf;
     f32 m_heightf;
     bool m_transparent;
-    ptr_mut<Vector4<f32>> m_pixels;
+    TextureKind m_kind;
+    ptr<TexelDecode> m_decode;
+    ptr<u8> m_texels;
+    std::shared_ptr<const void> m_storage;
+    std::string m_path;
     TextureId m_id;
 
     friend class ResourceStore;
+    friend class TextureCache;
 
-    explicit Texture(usize width, usize height, bool transparent, ptr_mut<Vector4<f32>> pixels) : m_width(width), m_height(height), m_widthf(width), m_heightf(height), m_transparent(transparent), m_pixels(pixels) {}
-public:
-    Texture(Texture&& texture) noexcept {
-        m_id = texture.m_id;
-        m_width = texture.m_width;
-        m_height = texture.m_height;
-        m_widthf = texture.m_widthf;
-        m_heightf = texture.m_heightf;
-        m_transparent = texture.m_transparent;
-        m_pixels = texture.m_pixels;
-        texture.m_pixels = nullptr;
+    explicit Texture(usize width, usize height, bool transparent, TextureKind kind, ptr<u8> texels, std::shared_ptr<const void> storage) :
+        m_width(width), m_height(height), m_widthf(width), m_heightf(height), m_transparent(transparent),
+        m_kind(kind), m_decode(&TexelDecode::of(kind)), m_texels(texels), m_storage(std::move(storage)) {}
+
+    [[nodiscard]]
+    static bool any_transparent(ptr<u8> texels, usize count) {
+        bool transparent = false;
+        for (usize i = 0; i < count; i++) {
+            transparent |= texels[i*4+3] != 255;
+        }
+        return transparent;
     }
 
-    ~Texture() {
-        delete[] this->m_pixels;
+    /**
+     * Takes over the texels of a texture loaded later, keeping this texture's path and id
+     */
+    void replace_texels(Texture&& other) {
+        m_width = other.m_width;
+        m_height = other.m_height;
+        m_widthf = other.m_widthf;
+        m_heightf = other.m_heightf;
+        m_transparent = other.m_transparent;
+        m_kind = other.m_kind;
+        m_decode = other.m_decode;
+        m_texels = other.m_texels;
+        m_storage = std::move(other.m_storage);
     }
+public:
+    Texture(Texture&& texture) noexcept = default;
 
     [[nodiscard]]
     usize width() const {
@@ -85,32 +142,49 @@ public:
     }
 
     [[nodiscard]]
-    TextureId get_id() const {
-        return this->m_id;
+    TextureKind kind() const {
+        return this->m_kind;
     }
 
+    /**
+     * @return the path this texture was requested from
+     */
     [[nodiscard]]
-    ref<Vector4<f32>> operator[](const usize i) const {
-        return this->m_pixels[i];
+    ref<std::string> path() const {
+        return this->m_path;
+    }
+
+    [[nodiscard]]
+    TextureId get_id() const {
+        return this->m_id;
     }
 
+    /**
+     * @return the raw RGBA8 texels of this texture, width*height*4 bytes
+     */
     [[nodiscard]]
-    ref_mut<Vector4<f32>> operator[](const usize i) {
-        return this->m_pixels[i];
+    ptr<u8> texels() const {
+        return this->m_texels;
     }
 
     [[nodiscard]]
-    ref<Vector4<f32>> operator[](ref<Vector2<usize>> coord) const {
-        return this->m_pixels[coord.x() + coord.y()*this->width()];
+    INLINE Vector4<f32> operator[](const usize i) const {
+        const auto texel = this->m_texels + i*4;
+        return {
+            this->m_decode->color[texel[0]],
+            this->m_decode->color[texel[1]],
+            this->m_decode->color[texel[2]],
+            this->m_decode->alpha[texel[3]],
+        };
     }
 
     [[nodiscard]]
-    ref_mut<Vector4<f32>> operator[](ref<Vector2<usize>> coord) {
-        return this->m_pixels[coord.x() + coord.y()*this->width()];
+    INLINE Vector4<f32> operator[](ref<Vector2<usize>> coord) const {
+        return (*this)[coord.x() + coord.y()*this->width()];
     }
 
     [[nodiscard]]
-    INLINE ref<Vector4<f32>> resolve_uv_wrapping(ref<Vector2<f32>> uv) const {
+    INLINE Vector4<f32> resolve_uv_wrapping(ref<Vector2<f32>> uv) const {
         const auto x = euclidean_remainder(
             static_cast<isize>(uv.x() * this->widthf()),
             static_cast<isize>(this->width())
@@ -119,7 +193,7 @@ public:
             static_cast<isize>(this->height()) - static_cast<isize>(uv.y() * this->heightf()),
             static_cast<isize>(this->height())
             );
-        return this->m_pixels[x+y*this->width()];
+        return (*this)[x+y*this->width()];
     }
 
 };
@@ -0,0 +1,152 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <unistd.h>
+
+#include <resources/texture.h>
+#include <util/mapped_file.h>
+
+/**
+ * Keeps already decoded and converted textures on disk so later runs can map the texels straight into memory.
+ *
+ * Every source texture gets its own file in the cache directory, named after a hash of its path and kind.
+ * A cache file is only used while the size and modification time of its source still match.
+ */
+class TextureCache {
+    static constexpr u32 MAGIC = 0x43585454; // TTXC
+    static constexpr u32 VERSION = 1;
+    static constexpr usize TEXEL_ALIGNMENT = 64;
+
+    struct Header {
+        u32 magic;
+        u32 version;
+        u32 kind;
+        u32 transparent;
+        u64 source_size;
+        i64 source_mtime;
+        u64 width;
+        u64 height;
+        u64 path_length;
+    };
+
+    std::filesystem::path m_dir;
+
+    [[nodiscard]]
+    static u64 hash(ref<std::string> str) {
+        u64 hash = 0xcbf29ce484222325ull;
+        for (const auto c : str) {
+            hash ^= static_cast<u8>(c);
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    [[nodiscard]]
+    static usize texel_offset(usize path_length) {
+        const auto end = sizeof(Header) + path_length;
+        return (end + TEXEL_ALIGNMENT - 1) / TEXEL_ALIGNMENT * TEXEL_ALIGNMENT;
+    }
+
+    [[nodiscard]]
+    std::string entry(ref<std::string> source, TextureKind kind) const {
+        std::stringstream ss;
+        ss << std::hex << std::setw(16) << std::setfill('0') << hash(source) << "_" << static_cast<u32>(kind) << ".tex";
+        return (m_dir / ss.str()).string();
+    }
+
+public:
+    explicit TextureCache(std::filesystem::path dir) : m_dir(std::move(dir)) {
+        std::error_code error;
+        std::filesystem::create_directories(m_dir, error);
+        if (error) {
+            std::cout << "Failed to create texture cache directory '" << m_dir.string() << "': " << error.message() << std::endl;
+        }
+    }
+
+    /**
+     * @return the cached texture for the source if one exists and is still up to date, its texels are mapped from the cache file
+     */
+    [[nodiscard]]
+    std::optional<Texture> load(ref<std::string> source, TextureKind kind) const {
+        const auto stamp = FileStamp::of(source);
+        if (!stamp) return std::nullopt;
+
+        auto file = MappedFile::open(entry(source, kind));
+        if (!file) return std::nullopt;
+
+        const auto header = file->at<Header>(0);
+        if (!header
+            || header->magic != MAGIC
+            || header->version != VERSION
+            || header->kind != static_cast<u32>(kind)
+            || FileStamp{header->source_size, header->source_mtime} != *stamp
+            || header->width == 0 || header->height == 0) {
+            return std::nullopt;
+        }
+
+        const auto path = file->at<char>(sizeof(Header), header->path_length);
+        if (!path || std::string(path, header->path_length) != source) return std::nullopt;
+
+        const auto texels = file->at<u8>(texel_offset(header->path_length), header->width*header->height*4);
+        if (!texels) return std::nullopt;
+
+        const auto width = header->width;
+        const auto height = header->height;
+        const auto transparent = header->transparent != 0;
+        return Texture{width, height, transparent, kind, texels, std::make_shared<const MappedFile>(std::move(*file))};
+    }
+
+    /**
+     * Writes the texture to the cache, the file is written under a temporary name first so a partial write is never picked up
+     */
+    void store(ref<std::string> source, ref<Texture> texture) const {
+        const auto stamp = FileStamp::of(source);
+        if (!stamp) return;
+
+        const Header header{
+            MAGIC,
+            VERSION,
+            static_cast<u32>(texture.kind()),
+            texture.transparent(),
+            stamp->size,
+            stamp->mtime,
+            texture.width(),
+            texture.height(),
+            source.size(),
+        };
+
+        const auto path = entry(source, texture.kind());
+        const auto temp = path + ".tmp" + std::to_string(getpid());
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            const std::array<char, TEXEL_ALIGNMENT> padding{};
+            out.write(reinterpret_cast<ptr<char>>(&header), sizeof(Header));
+            out.write(source.data(), static_cast<std::streamsize>(source.size()));
+            out.write(padding.data(), static_cast<std::streamsize>(texel_offset(source.size()) - sizeof(Header) - source.size()));
+            out.write(reinterpret_cast<ptr<char>>(texture.texels()), static_cast<std::streamsize>(texture.width()*texture.height()*4));
+            if (!out) {
+                std::cout << "Failed to write texture cache entry: " << path << std::endl;
+                out.close();
+                std::error_code error;
+                std::filesystem::remove(temp, error);
+                return;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temp, path, error);
+        if (error) {
+            std::cout << "Failed to write texture cache entry '" << path << "': " << error.message() << std::endl;
+            std::filesystem::remove(temp, error);
+        }
+    }
+};
+
+#endif //TEXTURE_CACHE_H
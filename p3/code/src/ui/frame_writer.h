@@ -0,0 +1,289 @@
+#ifndef FRAME_WRITER_H
+#define FRAME_WRITER_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include <stb_image_write.h>
+
+#include <ui/image_encoders.h>
+#include <util/trace.h>
+#include <util/types.h>
+
+/**
+ * File formats frames can be written in. PNG is the smallest but by far the slowest to encode, the others are
+ * meant for frames that are turned into a video right after.
+ */
+struct FrameFormats {
+
+    enum Kind {
+        Png,
+        Qoi,
+        Ppm,
+        Pam,
+    } kind;
+
+    FrameFormats(Kind kind) : kind(kind) {} // NOLINT
+
+    operator Kind() const { return kind; } // NOLINT
+
+    /**
+     * @return the name, which is also the file extension
+     */
+    std::string_view str() const { // NOLINT
+        switch (kind) {
+            case Png:
+                return "png";
+            case Qoi:
+                return "qoi";
+            case Ppm:
+                return "ppm";
+            case Pam:
+                return "pam";
+        }
+        return "png";
+    }
+};
+
+/**
+ * Raw video formats frames can be streamed in, one frame after another, for an encoder reading a pipe
+ */
+struct StreamFormats {
+
+    enum Kind {
+        Rgba,
+        Rgb,
+        Y4m,
+    } kind;
+
+    StreamFormats(Kind kind) : kind(kind) {} // NOLINT
+
+    operator Kind() const { return kind; } // NOLINT
+
+    std::string_view str() const { // NOLINT
+        switch (kind) {
+            case Rgba:
+                return "rgba";
+            case Rgb:
+                return "rgb";
+            case Y4m:
+                return "y4m";
+        }
+        return "rgba";
+    }
+};
+
+/**
+ * Encodes frames to image files on writer threads. A frame is converted into a staging buffer on the calling thread
+ * and queued, the writer threads compress and write it and hand the buffer back for the next frame. There are only
+ * so many staging buffers, once all of them are queued or being written the caller waits for one to be freed.
+ *
+ * Frames can also be appended to a stream instead, which a single writer thread does in the order they were written.
+ */
+class FrameWriter {
+public:
+    static constexpr usize CHANNELS = 4;
+    // the frame rate told to encoders of a Y4M stream, the same make_mp4.sh encodes frame files at
+    static constexpr usize STREAM_FRAME_RATE = 30;
+
+private:
+    struct Staging {
+        std::vector<u8> data{};
+        usize width{0};
+        usize height{0};
+        std::string path{};
+        // what the encoders build the file in, kept with the buffer so it is only allocated once
+        std::vector<u8> encoded{};
+    };
+
+    std::variant<FrameFormats, StreamFormats> m_format;
+    std::FILE* m_stream{nullptr};
+    // only touched by the one writer thread of a stream
+    bool m_stream_started{false};
+
+    std::vector<std::thread> m_writers{};
+    std::deque<std::unique_ptr<Staging>> m_queued{};
+    std::vector<std::unique_ptr<Staging>> m_free{};
+    // staging buffers that exist, free or not
+    usize m_buffers{0};
+    usize m_capacity;
+    usize m_writing{0};
+    bool m_stopping{false};
+
+    std::mutex m_mutex{};
+    std::condition_variable m_wake_writer{};
+    std::condition_variable m_wake_caller{};
+
+    bool encode(ref_mut<Staging> staging) {
+        if (const auto* stream_format = std::get_if<StreamFormats>(&m_format)) {
+            return append(*stream_format, staging);
+        }
+        auto& [data, width, height, path, encoded] = staging;
+        switch (std::get<FrameFormats>(m_format)) {
+            case FrameFormats::Png: {
+                const auto stride = static_cast<int>(width * CHANNELS);
+                return stbi_write_png(path.c_str(), static_cast<int>(width), static_cast<int>(height), CHANNELS, data.data(), stride);
+            }
+            case FrameFormats::Qoi:
+                return ImageEncoders::write_qoi(path, width, height, data.data(), encoded);
+            case FrameFormats::Ppm:
+                return ImageEncoders::write_ppm(path, width, height, data.data(), encoded);
+            case FrameFormats::Pam:
+                return ImageEncoders::write_pam(path, width, height, data.data(), encoded);
+        }
+        return false;
+    }
+
+    bool append(StreamFormats format, ref_mut<Staging> staging) {
+        auto& [data, width, height, path, encoded] = staging;
+        if (format == StreamFormats::Rgba) {
+            return std::fwrite(data.data(), 1, data.size(), m_stream) == data.size();
+        }
+        encoded.clear();
+        if (format == StreamFormats::Rgb) {
+            ImageEncoders::append_rgb(width, height, data.data(), encoded);
+        } else {
+            // the stream header describes every frame, so all frames have the size of the first
+            std::string header = m_stream_started ? "" :
+                "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height) +
+                " F" + std::to_string(STREAM_FRAME_RATE) + ":1 Ip A1:1 C420jpeg\n";
+            header += "FRAME\n";
+            encoded.assign(header.begin(), header.end());
+            ImageEncoders::append_yuv420(width, height, data.data(), encoded);
+        }
+        m_stream_started = true;
+        return std::fwrite(encoded.data(), 1, encoded.size(), m_stream) == encoded.size();
+    }
+
+    void work() {
+        TRACE_THREAD("frame writer");
+        while (true) {
+            std::unique_ptr<Staging> staging;
+            {
+                std::unique_lock lock{m_mutex};
+                m_wake_writer.wait(lock, [this] { return m_stopping || !m_queued.empty(); });
+                // frames already queued are still written when stopping
+                if (m_queued.empty()) return;
+                staging = std::move(m_queued.front());
+                m_queued.pop_front();
+                m_writing++;
+            }
+
+            TRACE_SCOPE("encode_frame");
+            if (!encode(*staging)) {
+                std::cout << "Failed to write frame: " << staging->path << std::endl;
+            }
+
+            {
+                std::lock_guard lock{m_mutex};
+                m_free.push_back(std::move(staging));
+                m_writing--;
+            }
+            m_wake_caller.notify_all();
+        }
+    }
+
+public:
+    /**
+     * @param format what every frame is encoded as, the path given to write should end in its extension
+     * @param threads how many frames are encoded at once
+     * @param capacity how many frames can be queued or being written before write blocks
+     */
+    FrameWriter(FrameFormats format, usize threads, usize capacity) : m_format(format), m_capacity(std::max({capacity, threads, usize{1}})) {
+        for (usize i = 0; i < std::max<usize>(threads, 1); i++) {
+            m_writers.emplace_back([this] { work(); });
+        }
+    }
+
+    /**
+     * @param format how frames are appended to the stream, every frame has to have the same size
+     * @param stream where frames go in the order they are written, it stays open once the writer is gone
+     * @param capacity how many frames can be queued or being written before write blocks
+     */
+    FrameWriter(StreamFormats format, std::FILE* stream, usize capacity) :
+        m_format(format), m_stream(stream), m_capacity(std::max<usize>(capacity, 1)) {
+        m_writers.emplace_back([this] { work(); });
+    }
+
+    /**
+     * Sets how hard PNG frames are compressed, for every writer since the encoder only has global settings
+     * @param level zlib effort, higher is smaller and slower, the encoder treats anything below 5 as 5
+     * @param filter if every row tries each PNG filter and keeps the best, otherwise rows are stored unfiltered
+     */
+    static void png_compression(i32 level, bool filter) {
+        stbi_write_png_compression_level = level;
+        stbi_write_force_png_filter = filter ? -1 : 0;
+    }
+
+    FrameWriter(ref<FrameWriter>) = delete;
+    FrameWriter& operator=(ref<FrameWriter>) = delete;
+
+    /**
+     * Writes out every queued frame before returning
+     */
+    ~FrameWriter() {
+        {
+            std::lock_guard lock{m_mutex};
+            m_stopping = true;
+        }
+        m_wake_writer.notify_all();
+        for (auto& writer : m_writers) {
+            writer.join();
+        }
+        if (m_stream) std::fflush(m_stream);
+    }
+
+    /**
+     * Queues a frame to be written to path, or appended to the stream where path only names it in errors.
+     * Waits first if every staging buffer is in use.
+     * @param convert fills the staging buffer, given as a pointer to width * height pixels of CHANNELS 8 bit values
+     */
+    template<typename Convert>
+    void write(usize width, usize height, std::string path, Convert&& convert) {
+        std::unique_ptr<Staging> staging;
+        {
+            std::unique_lock lock{m_mutex};
+            m_wake_caller.wait(lock, [this] { return !m_free.empty() || m_buffers < m_capacity; });
+            if (!m_free.empty()) {
+                staging = std::move(m_free.back());
+                m_free.pop_back();
+            } else {
+                staging = std::make_unique<Staging>();
+                m_buffers++;
+            }
+        }
+
+        staging->width = width;
+        staging->height = height;
+        staging->path = std::move(path);
+        staging->data.resize(width * height * CHANNELS);
+        convert(staging->data.data());
+
+        {
+            std::lock_guard lock{m_mutex};
+            m_queued.push_back(std::move(staging));
+        }
+        m_wake_writer.notify_one();
+    }
+
+    /**
+     * Blocks until every queued frame has been written
+     */
+    void flush() {
+        std::unique_lock lock{m_mutex};
+        m_wake_caller.wait(lock, [this] { return m_queued.empty() && m_writing == 0; });
+        if (m_stream) std::fflush(m_stream);
+    }
+};
+
+#endif //FRAME_WRITER_H
@@ -5,14 +5,34 @@
 #include <vector>
 #include <chrono>
 #include <cctype>
+#include <cstring>
 
 #include <game.h>
 #include <args.h>
+#include <renderer/frame_pipeline.h>
 #include <ui/gui.h>
 
 InputState input{};
 VisualKind visual = VisualKind::Color;
 
+/**
+ * The heatmap the renderer draws for a visual, none for those showing raw pixel values
+ */
+Heatmaps heatmap(const VisualKind visual) {
+    switch (visual) {
+        case VisualKind::Overdraw:
+            return Heatmaps::Overdraw;
+        case VisualKind::Lights:
+            return Heatmaps::Lights;
+        case VisualKind::Triangles:
+            return Heatmaps::Triangles;
+        case VisualKind::ShadingTime:
+            return Heatmaps::ShadingTime;
+        default:
+            return Heatmaps::None;
+    }
+}
+
 void key_callback(GLFWwindow *window, int key, int /*scancode*/, int action, int mods) {
     const auto shift = (GLFW_MOD_SHIFT&mods)!=0;
     const auto ctrl = (GLFW_MOD_CONTROL&mods)!=0;
@@ -127,6 +147,7 @@ void handle_game_input(Game *game, f32 delta) {
 
     game->scene.m_camera.target = facing+game->scene.m_camera.position;
 
+    const auto previous = visual;
     if (input.keys[GLFW_KEY_C].pressed) {
         visual = VisualKind::Color;
     }else if (input.keys[GLFW_KEY_F].pressed) {
@@ -145,110 +166,113 @@ void handle_game_input(Game *game, f32 delta) {
         visual = VisualKind::Metalic;
     }else if (input.keys[GLFW_KEY_X].pressed) {
         visual = VisualKind::X;
+    }else if (input.keys[GLFW_KEY_O].pressed) {
+        visual = VisualKind::Overdraw;
+    }else if (input.keys[GLFW_KEY_L].pressed) {
+        visual = VisualKind::Lights;
+    }else if (input.keys[GLFW_KEY_G].pressed) {
+        visual = VisualKind::Triangles;
+    }else if (input.keys[GLFW_KEY_H].pressed) {
+        visual = VisualKind::ShadingTime;
+    }
+    // a heatmap given on the command line stays until another visual is picked
+    if (visual != previous) {
+        game->render_settings.heatmap = heatmap(visual);
     }
 }
 
-void fill_buffer(const VisualKind visual, Game *game, std::vector<f32> &pixels) {
+/**
+ * The color and heatmap visuals are already encoded by shading and go to colors, every other visual is raw values in pixels
+ */
+void fill_buffer(const VisualKind visual, ref<FrameBuffer> frame, ref_mut<JobSystem> jobs, std::vector<f32> &pixels, std::vector<u32> &colors) {
     switch (visual) {
-        case VisualKind::Color: {
-            #ifdef USE_OPEN_MP
-            #pragma omp parallel for
-            #endif
-            for (usize i = 0; i < game->frame_buffer.width() * game->frame_buffer.height(); i++) {
-                pixels[i*4+0] = game->frame_buffer[i].diffuse.x();
-                pixels[i*4+1] = game->frame_buffer[i].diffuse.y();
-                pixels[i*4+2] = game->frame_buffer[i].diffuse.z();
-                pixels[i*4+3] = 1.f;
-            }
+        case VisualKind::Color:
+        case VisualKind::Overdraw:
+        case VisualKind::Lights:
+        case VisualKind::Triangles:
+        case VisualKind::ShadingTime: {
+            std::memcpy(colors.data(), frame.colors().data(), frame.size() * sizeof(u32));
         }break;
         case VisualKind::Depth: {
-            #ifdef USE_OPEN_MP
-            #pragma omp parallel for
-            #endif
-            for (usize i = 0; i < game->frame_buffer.width() * game->frame_buffer.height(); i++) {
-                pixels[i*4+0] = game->frame_buffer[i].depth;
-                pixels[i*4+3] = 1.f;
-            }
+            jobs.parallel_for(0, frame.size(), frame.width(), [&](usize begin, usize end) {
+                for (usize i = begin; i < end; i++) {
+                    pixels[i*4+0] = frame[i].depth;
+                    pixels[i*4+3] = 1.f;
+                }
+            });
         }break;
         case VisualKind::Normal: {
 
-            #ifdef USE_OPEN_MP
-            #pragma omp parallel for
-            #endif
-            for (usize i = 0; i < game->frame_buffer.width() * game->frame_buffer.height(); i++) {
-                pixels[i*4+0] = game->frame_buffer[i].normal.x();
-                pixels[i*4+1] = game->frame_buffer[i].normal.y();
-                pixels[i*4+2] = game->frame_buffer[i].normal.z();
-                pixels[i*4+3] = 1.f;
-            }
+            jobs.parallel_for(0, frame.size(), frame.width(), [&](usize begin, usize end) {
+                for (usize i = begin; i < end; i++) {
+                    pixels[i*4+0] = frame[i].normal.x();
+                    pixels[i*4+1] = frame[i].normal.y();
+                    pixels[i*4+2] = frame[i].normal.z();
+                    pixels[i*4+3] = 1.f;
+                }
+            });
         }break;
         case VisualKind::Bitangent: {
 
-            #ifdef USE_OPEN_MP
-            #pragma omp parallel for
-            #endif
-            for (usize i = 0; i < game->frame_buffer.width() * game->frame_buffer.height(); i++) {
-                pixels[i*4+0] = game->frame_buffer[i].bitangent.x();
-                pixels[i*4+1] = game->frame_buffer[i].bitangent.y();
-                pixels[i*4+2] = game->frame_buffer[i].bitangent.z();
-                pixels[i*4+3] = 1.f;
-            }
+            jobs.parallel_for(0, frame.size(), frame.width(), [&](usize begin, usize end) {
+                for (usize i = begin; i < end; i++) {
+                    pixels[i*4+0] = frame[i].bitangent.x();
+                    pixels[i*4+1] = frame[i].bitangent.y();
+                    pixels[i*4+2] = frame[i].bitangent.z();
+                    pixels[i*4+3] = 1.f;
+                }
+            });
         }break;
         case VisualKind::Tangent: {
 
-            #ifdef USE_OPEN_MP
-            #pragma omp parallel for
-            #endif
-            for (usize i = 0; i < game->frame_buffer.width() * game->frame_buffer.height(); i++) {
-                pixels[i*4+0] = game->frame_buffer[i].tangent.x();
-                pixels[i*4+1] = game->frame_buffer[i].tangent.y();
-                pixels[i*4+2] = game->frame_buffer[i].tangent.z();
-                pixels[i*4+3] = 1.f;
-            }
+            jobs.parallel_for(0, frame.size(), frame.width(), [&](usize begin, usize end) {
+                for (usize i = begin; i < end; i++) {
+                    pixels[i*4+0] = frame[i].tangent.x();
+                    pixels[i*4+1] = frame[i].tangent.y();
+                    pixels[i*4+2] = frame[i].tangent.z();
+                    pixels[i*4+3] = 1.f;
+                }
+            });
         }break;
         case VisualKind::Position: {
-            #ifdef USE_OPEN_MP
-            #pragma omp parallel for
-            #endif
-            for (usize i = 0; i < game->frame_buffer.width() * game->frame_buffer.height(); i++) {
-                pixels[i*4+0] = game->frame_buffer[i].position.x();
-                pixels[i*4+1] = game->frame_buffer[i].position.y();
-                pixels[i*4+2] = game->frame_buffer[i].position.z();
-                pixels[i*4+3] = 1.f;
-            }
+            jobs.parallel_for(0, frame.size(), frame.width(), [&](usize begin, usize end) {
+                for (usize i = begin; i < end; i++) {
+                    pixels[i*4+0] = frame[i].position.x();
+                    pixels[i*4+1] = frame[i].position.y();
+                    pixels[i*4+2] = frame[i].position.z();
+                    pixels[i*4+3] = 1.f;
+                }
+            });
         }break;
         case VisualKind::X: {
-            #ifdef USE_OPEN_MP
-            #pragma omp parallel for
-            #endif
-            for (usize i = 0; i < game->frame_buffer.width() * game->frame_buffer.height(); i++) {
-                pixels[i*4+0] = game->frame_buffer[i].specular.x();
-                pixels[i*4+1] = game->frame_buffer[i].specular.x();
-                pixels[i*4+2] = game->frame_buffer[i].specular.x();
-                pixels[i*4+3] = 1.f;
-            }
+            jobs.parallel_for(0, frame.size(), frame.width(), [&](usize begin, usize end) {
+                for (usize i = begin; i < end; i++) {
+                    pixels[i*4+0] = frame[i].specular.x();
+                    pixels[i*4+1] = frame[i].specular.x();
+                    pixels[i*4+2] = frame[i].specular.x();
+                    pixels[i*4+3] = 1.f;
+                }
+            });
         }break;
         case VisualKind::Roughness: {
-            #ifdef USE_OPEN_MP
-            #pragma omp parallel for
-            #endif
-            for (usize i = 0; i < game->frame_buffer.width() * game->frame_buffer.height(); i++) {
-                pixels[i*4+0] = game->frame_buffer[i].specular.y();
-                pixels[i*4+1] = game->frame_buffer[i].specular.y();
-                pixels[i*4+2] = game->frame_buffer[i].specular.y();
-                pixels[i*4+3] = 1.f;
-            }
+            jobs.parallel_for(0, frame.size(), frame.width(), [&](usize begin, usize end) {
+                for (usize i = begin; i < end; i++) {
+                    pixels[i*4+0] = frame[i].specular.y();
+                    pixels[i*4+1] = frame[i].specular.y();
+                    pixels[i*4+2] = frame[i].specular.y();
+                    pixels[i*4+3] = 1.f;
+                }
+            });
         }break;
         case VisualKind::Metalic: {
-            #ifdef USE_OPEN_MP
-            #pragma omp parallel for
-            #endif
-            for (usize i = 0; i < game->frame_buffer.width() * game->frame_buffer.height(); i++) {
-                pixels[i*4+0] = game->frame_buffer[i].specular.z();
-                pixels[i*4+1] = game->frame_buffer[i].specular.z();
-                pixels[i*4+2] = game->frame_buffer[i].specular.z();
-                pixels[i*4+3] = 1.f;
-            }
+            jobs.parallel_for(0, frame.size(), frame.width(), [&](usize begin, usize end) {
+                for (usize i = begin; i < end; i++) {
+                    pixels[i*4+0] = frame[i].specular.z();
+                    pixels[i*4+1] = frame[i].specular.z();
+                    pixels[i*4+2] = frame[i].specular.z();
+                    pixels[i*4+3] = 1.f;
+                }
+            });
         }break;
     }
 }
@@ -300,6 +324,7 @@ void run_gui(Arguments& args) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     std::vector<f32> pixels(game->frame_buffer.width() * game->frame_buffer.height() * 4);
+    std::vector<u32> colors(game->frame_buffer.width() * game->frame_buffer.height());
 
     // Fullscreen quad setup
     GLuint vao;
@@ -337,10 +362,8 @@ void run_gui(Arguments& args) {
         void main() {
             FragColor = texture(tex, texCoord);
 
-            if (kind == 0x63){ // c
-                FragColor.x = pow(FragColor.x, 1./2.2);
-                FragColor.y = pow(FragColor.y, 1./2.2);
-                FragColor.z = pow(FragColor.z, 1./2.2);
+            if (kind == 0x63){ // c, gamma encoded on the cpu
+                FragColor.w = 1.0;
             }else if (kind == 0x64){ // d
                 FragColor.x = pow(1.0 - FragColor.x / 256.0 / 256.0 / 256.0 / 256.0, 1./2.2);
                 FragColor.y = FragColor.x;
@@ -378,6 +401,8 @@ void run_gui(Arguments& args) {
 
     glUniform1i(glGetUniformLocation(prog, "tex"), 0);
 
+    FramePipeline pipeline{game->frame_buffer};
+
     usize frame_count = 0;
     const auto start = std::chrono::high_resolution_clock::now();
     auto frame_start = std::chrono::high_resolution_clock::now();
@@ -397,15 +422,22 @@ void run_gui(Arguments& args) {
 
         handle_game_input(game, delta);
 
-        game->update(delta, time);
-        game->render();
-
-        fill_buffer(visual, game, pixels);
+        // nothing is being shaded between steps, so loaded resources can be published
+        game->resource_store.poll();
+        // pixels gets the frame drawn by the previous step, shaded while this step draws the next one
+        pipeline.step(
+            game->scene, game->resource_store, game->render_settings, game->jobs, game->profiler,
+            [&] { game->update_systems(delta, time); },
+            [&](ref<FrameBuffer> frame) { fill_buffer(visual, frame, game->jobs, pixels, colors); }
+        );
 
         auto render_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now()-frame_start).count();
         fps *= 99.f/100.f;
         fps += (1.f/render_time*1000.f) / 100.f;
-        std::cout << "Frame: " << frame_count << " Render Time: " <<  render_time << " ms, FPS: " << fps << std::endl;
+        game->render_stats.end_frame();
+        std::cout << "Frame: " << frame_count << " Render Time: " <<  render_time << " ms, FPS: " << fps << ", ";
+        game->render_stats.print_last(std::cout);
+        std::cout << std::endl;
         frame_count += 1;
 
 
@@ -413,8 +445,13 @@ void run_gui(Arguments& args) {
         int vertexColorLocation = glGetUniformLocation(prog, "kind");
         glUniform1i(vertexColorLocation, static_cast<GLint>(visual));
         glBindTexture(GL_TEXTURE_2D, tex);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, game->frame_buffer.width(), game->frame_buffer.height(), 0,
-                     GL_RGBA, GL_FLOAT, pixels.data());
+        if (visual == VisualKind::Color || heatmap(visual) != Heatmaps::None) {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, game->frame_buffer.width(), game->frame_buffer.height(), 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, colors.data());
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, game->frame_buffer.width(), game->frame_buffer.height(), 0,
+                         GL_RGBA, GL_FLOAT, pixels.data());
+        }
 
         glClear(GL_COLOR_BUFFER_BIT);
         glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
@@ -53,6 +53,11 @@ enum class VisualKind : int {
     Roughness = 'r',
     Metalic = 'm',
     X = 'x',
+    // heatmaps, drawn by the renderer in place of the color
+    Overdraw = 'o',
+    Lights = 'l',
+    Triangles = 'g',
+    ShadingTime = 'h',
 };
 
 void run_gui(Arguments& args);
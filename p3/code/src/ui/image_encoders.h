@@ -0,0 +1,176 @@
+#ifndef IMAGE_ENCODERS_H
+#define IMAGE_ENCODERS_H
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <util/types.h>
+
+/**
+ * Encoders that are much cheaper than PNG, for frames that are only written to be read back right away.
+ * All of them take tightly packed 8 bit RGBA pixels and build the whole file in out before writing it at once.
+ */
+namespace ImageEncoders {
+
+    inline bool write_file(ref<std::string> path, ref<std::vector<u8>> bytes) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<ptr<char>>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        return static_cast<bool>(out);
+    }
+
+    inline void push_u32_be(ref_mut<std::vector<u8>> out, u32 value) {
+        out.push_back(static_cast<u8>(value >> 24));
+        out.push_back(static_cast<u8>(value >> 16));
+        out.push_back(static_cast<u8>(value >> 8));
+        out.push_back(static_cast<u8>(value));
+    }
+
+    /**
+     * Appends the pixels without their alpha
+     */
+    inline void append_rgb(usize width, usize height, ptr<u8> rgba, ref_mut<std::vector<u8>> out) {
+        const auto offset = out.size();
+        out.resize(offset + width * height * 3);
+        auto* rgb = out.data() + offset;
+        for (usize i = 0; i < width * height; i++) {
+            rgb[i*3] = rgba[i*4];
+            rgb[i*3+1] = rgba[i*4+1];
+            rgb[i*3+2] = rgba[i*4+2];
+        }
+    }
+
+    /**
+     * Appends the pixels as the planes of 4:2:0 YCbCr with BT.601 limited range, what encoders assume for
+     * untagged yuv420p. Every chroma sample averages the 2x2 pixels it covers.
+     */
+    inline void append_yuv420(usize width, usize height, ptr<u8> rgba, ref_mut<std::vector<u8>> out) {
+        const auto chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+        const auto offset = out.size();
+        out.resize(offset + width * height + 2 * chroma_width * chroma_height);
+        auto* y_plane = out.data() + offset;
+        auto* cb_plane = y_plane + width * height;
+        auto* cr_plane = cb_plane + chroma_width * chroma_height;
+
+        for (usize i = 0; i < width * height; i++) {
+            const auto r = static_cast<i32>(rgba[i*4]), g = static_cast<i32>(rgba[i*4+1]), b = static_cast<i32>(rgba[i*4+2]);
+            y_plane[i] = static_cast<u8>((66 * r + 129 * g + 25 * b + 128 + (16 << 8)) >> 8);
+        }
+        for (usize cy = 0; cy < chroma_height; cy++) {
+            for (usize cx = 0; cx < chroma_width; cx++) {
+                i32 r = 0, g = 0, b = 0, count = 0;
+                for (usize y = cy * 2; y < std::min(cy * 2 + 2, height); y++) {
+                    for (usize x = cx * 2; x < std::min(cx * 2 + 2, width); x++) {
+                        const auto i = x + y * width;
+                        r += rgba[i*4];
+                        g += rgba[i*4+1];
+                        b += rgba[i*4+2];
+                        count++;
+                    }
+                }
+                r /= count;
+                g /= count;
+                b /= count;
+                cb_plane[cx + cy * chroma_width] = static_cast<u8>((-38 * r - 74 * g + 112 * b + 128 + (128 << 8)) >> 8);
+                cr_plane[cx + cy * chroma_width] = static_cast<u8>((112 * r - 94 * g - 18 * b + 128 + (128 << 8)) >> 8);
+            }
+        }
+    }
+
+    /**
+     * Binary PPM, alpha is dropped
+     */
+    inline bool write_ppm(ref<std::string> path, usize width, usize height, ptr<u8> rgba, ref_mut<std::vector<u8>> out) {
+        const auto header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+        out.assign(header.begin(), header.end());
+        append_rgb(width, height, rgba, out);
+        return write_file(path, out);
+    }
+
+    /**
+     * PAM with an RGB_ALPHA tuple type, the pixels are copied as they are
+     */
+    inline bool write_pam(ref<std::string> path, usize width, usize height, ptr<u8> rgba, ref_mut<std::vector<u8>> out) {
+        const auto header = "P7\nWIDTH " + std::to_string(width) + "\nHEIGHT " + std::to_string(height) +
+            "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+        out.assign(header.begin(), header.end());
+        out.insert(out.end(), rgba, rgba + width * height * 4);
+        return write_file(path, out);
+    }
+
+    /**
+     * QOI, see https://qoiformat.org/qoi-specification.pdf
+     */
+    inline bool write_qoi(ref<std::string> path, usize width, usize height, ptr<u8> rgba, ref_mut<std::vector<u8>> out) {
+        constexpr u8 OP_INDEX = 0x00, OP_DIFF = 0x40, OP_LUMA = 0x80, OP_RUN = 0xc0, OP_RGB = 0xfe, OP_RGBA = 0xff;
+        constexpr u32 MAX_RUN = 62;
+
+        struct Color {
+            u8 r, g, b, a;
+            bool operator==(ref<Color> other) const {
+                return r == other.r && g == other.g && b == other.b && a == other.a;
+            }
+        };
+
+        out.clear();
+        // the worst case is an RGBA op for every pixel, plus the header and end marker
+        out.reserve(14 + width * height * 5 + 8);
+        out.insert(out.end(), {'q', 'o', 'i', 'f'});
+        push_u32_be(out, static_cast<u32>(width));
+        push_u32_be(out, static_cast<u32>(height));
+        // four channels, sRGB with linear alpha
+        out.push_back(4);
+        out.push_back(0);
+
+        std::array<Color, 64> seen{};
+        Color previous{0, 0, 0, 255};
+        u32 run = 0;
+        const auto count = width * height;
+        for (usize i = 0; i < count; i++) {
+            const Color pixel{rgba[i*4], rgba[i*4+1], rgba[i*4+2], rgba[i*4+3]};
+            if (pixel == previous) {
+                run++;
+                if (run == MAX_RUN || i + 1 == count) {
+                    out.push_back(static_cast<u8>(OP_RUN | (run - 1)));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0) {
+                out.push_back(static_cast<u8>(OP_RUN | (run - 1)));
+                run = 0;
+            }
+
+            const auto hash = (pixel.r * 3 + pixel.g * 5 + pixel.b * 7 + pixel.a * 11) % 64;
+            if (seen[hash] == pixel) {
+                out.push_back(static_cast<u8>(OP_INDEX | hash));
+            } else {
+                seen[hash] = pixel;
+                if (pixel.a == previous.a) {
+                    const auto dr = static_cast<i8>(pixel.r - previous.r);
+                    const auto dg = static_cast<i8>(pixel.g - previous.g);
+                    const auto db = static_cast<i8>(pixel.b - previous.b);
+                    const auto dr_dg = dr - dg;
+                    const auto db_dg = db - dg;
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                        out.push_back(static_cast<u8>(OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                    } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+                        out.push_back(static_cast<u8>(OP_LUMA | (dg + 32)));
+                        out.push_back(static_cast<u8>((dr_dg + 8) << 4 | (db_dg + 8)));
+                    } else {
+                        out.insert(out.end(), {OP_RGB, pixel.r, pixel.g, pixel.b});
+                    }
+                } else {
+                    out.insert(out.end(), {OP_RGBA, pixel.r, pixel.g, pixel.b, pixel.a});
+                }
+            }
+            previous = pixel;
+        }
+        out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+        return write_file(path, out);
+    }
+}
+
+#endif //IMAGE_ENCODERS_H
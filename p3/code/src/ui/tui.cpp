@@ -1,49 +1,21 @@
 #ifndef GUI
 
-#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <iomanip>
-
-#include <stb_image_write.h>
+#include <iostream>
+#include <optional>
 
 #include <game.h>
 #include <args.h>
-
-inline void write_image(ref<Game> game, std::string&& path) {
-    auto channels = 4;
-    auto data = new u8[game.frame_buffer.height()*game.frame_buffer.width()*channels];
-
-    #ifdef USE_OPEN_MP
-    #pragma omp parallel for
-    #endif
-    for (usize i = 0; i < game.frame_buffer.height() * game.frame_buffer.width(); i++) {
-        auto color = game.frame_buffer[i].diffuse;
-        auto normal = game.frame_buffer[i].normal;
-        auto normal_color = (game.frame_buffer[i].tangent*0.5).add_scalar(0.5f);
-
-        // u8 r = game.frame_buffer[i].normal.dot(game.frame_buffer[i].tangent) * 255;
-        // u8 g = game.frame_buffer[i].normal.dot(game.frame_buffer[i].bitangent)* 255;
-        // u8 b = game.frame_buffer[i].bitangent.dot(game.frame_buffer[i].tangent)* 255;
-        // data[i*channels] = r;
-        // data[i*channels+1] = g;
-        // data[i*channels+2] = b;
-
-        data[i*channels] = static_cast<u8>(std::min(255.f, std::pow(color.x(), 1.f/2.2f) * 255));
-        data[i*channels+1] = static_cast<u8>(std::min(255.f, std::pow(color.y(), 1.f/2.2f) * 255));
-        data[i*channels+2] = static_cast<u8>(std::min(255.f, std::pow(color.z(), 1.f/2.2f) * 255));
-
-
-
-        // data[i*channels] = static_cast<u8>(std::min(255.f, normal_color.x() * 255));
-        // data[i*channels+1] = static_cast<u8>(std::min(255.f, normal_color.y() * 255));
-        // data[i*channels+2] = static_cast<u8>(std::min(255.f, normal_color.z() * 255));
-        data[i*channels+3] = normal.magnitude_squared() != 0 ? 255 : 0;
-    }
-
-    auto width = game.frame_buffer.width();
-    auto height = game.frame_buffer.height();
-
-    stbi_write_png(path.c_str(), width, height, channels, data, width * channels);
-    delete[] data;
+#include <renderer/frame_pipeline.h>
+#include <ui/frame_writer.h>
+
+/**
+ * Copies out the 8 bit RGBA colors shading encoded, alpha marks the pixels something was drawn to
+ */
+inline void convert_frame(ref<FrameBuffer> frame, ptr_mut<u8> data) {
+    std::memcpy(data, frame.colors().data(), frame.size() * FrameWriter::CHANNELS);
 }
 
 inline std::string leading(int value, int total_length) {
@@ -54,26 +26,97 @@ inline std::string leading(int value, int total_length) {
 
 void run_tui(Arguments& args){
 
+    // raw frames can go to stdout for an encoder to read, then everything logged goes to stderr instead
+    auto* const cout_buffer = std::cout.rdbuf();
+    std::FILE* stream_file = nullptr;
+    if (args.stream) {
+        if (args.stream_path == "-") {
+            std::cout.rdbuf(std::cerr.rdbuf());
+            stream_file = stdout;
+        } else {
+            // opening a named pipe waits for its reader
+            stream_file = std::fopen(args.stream_path.c_str(), "wb");
+        }
+        if (!stream_file) {
+            std::cout << "Failed to open stream: " << args.stream_path << std::endl;
+            return;
+        }
+    }
+
     auto game = args.make_game();
+    // frames are written out, so render the fully loaded scene rather than placeholders
+    game->resource_store.wait();
 
     f64 total_duration = 3.;
     u64 frames = 300;
-    u64 total_ms = 0;
-    for (u64 i = 0; i < frames; i ++) {
-        auto start = std::chrono::high_resolution_clock::now();
-        game->update(1.f/total_duration, i*total_duration/frames);
-        game->render();
 
-        auto end = std::chrono::high_resolution_clock::now();
-        auto duration = end - start;
-        long long milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
-        total_ms += milliseconds;
-        std::cout << "Frame: " << (i+1) << " Render Time: " << milliseconds << " ms" << std::endl;
+    // frames are encoded beside rendering, which only waits once a few of them are queued
+    std::optional<FrameWriter> writer{};
+    if (args.write_frames) {
+        const usize writer_threads = std::max(1u, std::thread::hardware_concurrency() / 4);
+        FrameWriter::png_compression(args.png_compression, args.png_filter);
+        writer.emplace(args.frame_format, writer_threads, 2 * writer_threads);
+    }
+    // frames are streamed in order by one thread, a frame is converted while the one before is still being sent
+    std::optional<FrameWriter> stream{};
+    if (stream_file) {
+        stream.emplace(*args.stream, stream_file, 2);
+    }
 
-        if (args.write_frames)
-            write_image(*game, "../animation/frame_" + leading(i, 3) + ".png");
+    // each step shades and writes the frame drawn by the step before while it draws the next one
+    FramePipeline pipeline{game->frame_buffer};
+    u64 written = 0;
+    const auto output = [&](ref<FrameBuffer> frame) {
+        const auto zone = game->profiler.zone(Profiler::Stage::WriteImage);
+        if (writer) {
+            writer->write(frame.width(), frame.height(), "../animation/frame_" + leading(written, 3) + "." + std::string{args.frame_format.str()}, [&](ptr_mut<u8> data) {
+                convert_frame(frame, data);
+            });
+        }
+        if (stream) {
+            stream->write(frame.width(), frame.height(), args.stream_path, [&](ptr_mut<u8> data) {
+                convert_frame(frame, data);
+            });
+        }
+        written++;
+    };
+    auto& profiler = game->profiler;
+    auto& render_stats = game->render_stats;
+    for (u64 i = 0; i < frames; i ++) {
+        {
+            const auto zone = profiler.zone(Profiler::Stage::Frame);
+            // nothing is being shaded between steps, so loaded resources can be published
+            game->resource_store.poll();
+            pipeline.step(
+                game->scene, game->resource_store, game->render_settings, game->jobs, profiler,
+                [&] { game->update_systems(1.f/total_duration, i*total_duration/frames); },
+                output
+            );
+        }
+        profiler.end_frame();
+        render_stats.end_frame();
+        std::cout << "Frame: " << (i+1) << " Render Time: " << profiler.last(Profiler::Stage::Frame) / 1000. << " ms ";
+        render_stats.print_last(std::cout);
+        std::cout << std::endl;
     }
-    std::cout << "average frame time: " << (total_ms/300.0) << "ms" << std::endl;
+    pipeline.finish(game->resource_store, game->jobs, profiler, output);
+    if (writer) writer->flush();
+    // the last frame is shaded and written after the loop, it counts towards those stages but not frame time
+    profiler.end_frame();
+    render_stats.finish();
+    std::cout << "average frame time: " << profiler.summary(Profiler::Stage::Frame).mean / 1000. << "ms" << std::endl;
+    profiler.print(std::cout);
+    render_stats.print(std::cout);
+    if (!args.profile_path.empty()) {
+        const auto json = args.profile_path.size() >= 5 && args.profile_path.substr(args.profile_path.size() - 5) == ".json";
+        if (!(json ? profiler.write_json(args.profile_path) : profiler.write_csv(args.profile_path))) {
+            std::cout << "Failed to write profile: " << args.profile_path << std::endl;
+        }
+    }
+
+    stream.reset();
+    if (stream_file && stream_file != stdout) std::fclose(stream_file);
+    std::cout.rdbuf(cout_buffer);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,166 @@
+#ifndef BACKGROUND_JOBS_H
+#define BACKGROUND_JOBS_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <util/trace.h>
+#include <util/types.h>
+
+/**
+ * Runs long jobs like loading assets on worker threads. A job's result is handed back through a publish callback
+ * which runs on whichever thread calls poll, so results can be moved into state the render loop owns.
+ * Publish callbacks run in the order they were queued.
+ *
+ * With no worker threads jobs and their publish callbacks run immediately on the submitting thread.
+ */
+class BackgroundJobs {
+    std::vector<std::thread> m_workers{};
+    std::deque<std::function<void()>> m_jobs{};
+    std::deque<std::function<void()>> m_finished{};
+    // jobs submitted or posted whose publish callback has not run yet
+    usize m_pending{0};
+    bool m_stopping{false};
+
+    mutable std::mutex m_mutex{};
+    std::condition_variable m_wake_worker{};
+    std::condition_variable m_wake_poller{};
+
+    void work() {
+        TRACE_THREAD("background worker");
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock lock{m_mutex};
+                m_wake_worker.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+                if (m_stopping) return;
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+            }
+            TRACE_SCOPE("background_job");
+            job();
+        }
+    }
+
+public:
+    explicit BackgroundJobs(usize threads) {
+        for (usize i = 0; i < threads; i++) {
+            m_workers.emplace_back([this] { work(); });
+        }
+    }
+
+    BackgroundJobs(ref<BackgroundJobs>) = delete;
+    BackgroundJobs& operator=(ref<BackgroundJobs>) = delete;
+
+    /**
+     * Waits for running jobs to finish, jobs which have not started and unpublished results are dropped
+     */
+    ~BackgroundJobs() {
+        {
+            std::lock_guard lock{m_mutex};
+            m_stopping = true;
+        }
+        m_wake_worker.notify_all();
+        for (auto& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    [[nodiscard]]
+    bool asynchronous() const {
+        return !m_workers.empty();
+    }
+
+    /**
+     * Runs work on a worker thread and later passes its result to publish on the polling thread
+     */
+    template<typename Work, typename Publish>
+    void submit(Work&& work, Publish&& publish) {
+        using Result = std::invoke_result_t<Work>;
+        if (!asynchronous()) {
+            publish(work());
+            return;
+        }
+
+        auto job = [this, work = std::forward<Work>(work), publish = std::forward<Publish>(publish)]() mutable {
+            auto result = std::make_shared<Result>(work());
+            {
+                std::lock_guard lock{m_mutex};
+                m_finished.emplace_back([publish = std::move(publish), result]() mutable { publish(std::move(*result)); });
+            }
+            m_wake_poller.notify_all();
+        };
+        {
+            std::lock_guard lock{m_mutex};
+            m_pending++;
+            m_jobs.emplace_back(std::move(job));
+        }
+        m_wake_worker.notify_one();
+    }
+
+    /**
+     * Queues publish to run on the polling thread after everything queued before it
+     */
+    template<typename Publish>
+    void post(Publish&& publish) {
+        if (!asynchronous()) {
+            publish();
+            return;
+        }
+        {
+            std::lock_guard lock{m_mutex};
+            m_pending++;
+            m_finished.emplace_back(std::forward<Publish>(publish));
+        }
+        m_wake_poller.notify_all();
+    }
+
+    /**
+     * Runs the publish callbacks of every job that finished since the last poll
+     * @return how many were run
+     */
+    usize poll() {
+        std::deque<std::function<void()>> finished;
+        {
+            std::lock_guard lock{m_mutex};
+            finished.swap(m_finished);
+        }
+        for (auto& publish : finished) {
+            publish();
+        }
+        {
+            std::lock_guard lock{m_mutex};
+            m_pending -= finished.size();
+        }
+        return finished.size();
+    }
+
+    /**
+     * Polls until every job, including ones submitted by other jobs or publish callbacks, has been published
+     */
+    void wait() {
+        while (true) {
+            poll();
+            std::unique_lock lock{m_mutex};
+            if (m_pending == 0) return;
+            m_wake_poller.wait(lock, [this] { return !m_finished.empty(); });
+        }
+    }
+
+    /**
+     * @return how many jobs have not been published yet
+     */
+    [[nodiscard]]
+    usize pending() const {
+        std::lock_guard lock{m_mutex};
+        return m_pending;
+    }
+};
+
+#endif //BACKGROUND_JOBS_H
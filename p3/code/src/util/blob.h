@@ -0,0 +1,90 @@
+#ifndef BLOB_H
+#define BLOB_H
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <util/types.h>
+
+/**
+ * A range of elements inside a blob, stored in place of a pointer
+ */
+struct BlobSpan {
+    u64 offset{0};
+    u64 count{0};
+};
+
+/**
+ * Builds a binary file in memory where every array is aligned so it can be used in place once the file is mapped
+ */
+class BlobWriter {
+    static constexpr usize ALIGNMENT = 64;
+
+    std::vector<u8> m_bytes{};
+
+    usize align() {
+        m_bytes.resize((m_bytes.size() + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+        return m_bytes.size();
+    }
+
+public:
+    /**
+     * Reserves zeroed space for a value to be written later, used for headers that reference data appended after them
+     * @return the offset of the reserved value
+     */
+    template<typename T>
+    usize reserve(usize count = 1) {
+        const auto offset = align();
+        m_bytes.resize(offset + sizeof(T)*count);
+        return offset;
+    }
+
+    template<typename T>
+    void write(usize offset, ref<T> value) {
+        std::memcpy(m_bytes.data() + offset, &value, sizeof(T));
+    }
+
+    template<typename T>
+    BlobSpan append(ptr<T> data, usize count) {
+        const auto offset = reserve<T>(count);
+        if (count != 0) std::memcpy(m_bytes.data() + offset, data, sizeof(T)*count);
+        return {offset, count};
+    }
+
+    BlobSpan append(ref<std::string> str) {
+        return append(str.data(), str.size());
+    }
+
+    /**
+     * Writes the blob under a temporary name first and renames it so a partially written file is never picked up
+     * @return if the file was written
+     */
+    [[nodiscard]]
+    bool save(ref<std::string> path) const {
+        const auto temp = path + ".tmp" + std::to_string(getpid());
+        {
+            std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<ptr<char>>(m_bytes.data()), static_cast<std::streamsize>(m_bytes.size()));
+            if (!out) {
+                out.close();
+                std::error_code error;
+                std::filesystem::remove(temp, error);
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temp, path, error);
+        if (error) {
+            std::filesystem::remove(temp, error);
+            return false;
+        }
+        return true;
+    }
+};
+
+#endif //BLOB_H
@@ -0,0 +1,76 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <memory>
+#include <vector>
+
+#include <util/types.h>
+
+/**
+ * Immutable contiguous storage which either owns its elements or borrows them from shared storage, like a mapped file.
+ * Copying a borrowed buffer only copies the reference to its storage.
+ */
+template<typename T>
+class Buffer {
+    std::vector<T> m_owned{};
+    std::shared_ptr<const void> m_storage{};
+    ptr<T> m_data{nullptr};
+    usize m_len{0};
+
+public:
+    Buffer() = default;
+
+    Buffer(std::vector<T>&& owned) : m_owned(std::move(owned)), m_data(m_owned.data()), m_len(m_owned.size()) {} // NOLINT
+
+    Buffer(ptr<T> data, usize len, std::shared_ptr<const void> storage) : m_storage(std::move(storage)), m_data(data), m_len(len) {}
+
+    Buffer(ref<Buffer> other) : m_owned(other.m_owned), m_storage(other.m_storage), m_data(other.m_data), m_len(other.m_len) {
+        if (!m_storage) m_data = m_owned.data();
+    }
+
+    Buffer(Buffer&& other) noexcept : m_owned(std::move(other.m_owned)), m_storage(std::move(other.m_storage)), m_data(other.m_data), m_len(other.m_len) {
+        if (!m_storage) m_data = m_owned.data();
+        other.m_data = nullptr;
+        other.m_len = 0;
+    }
+
+    Buffer& operator=(Buffer other) noexcept {
+        m_owned = std::move(other.m_owned);
+        m_storage = std::move(other.m_storage);
+        m_len = other.m_len;
+        m_data = m_storage ? other.m_data : m_owned.data();
+        return *this;
+    }
+
+    [[nodiscard]]
+    usize size() const {
+        return m_len;
+    }
+
+    [[nodiscard]]
+    bool empty() const {
+        return m_len == 0;
+    }
+
+    [[nodiscard]]
+    ptr<T> data() const {
+        return m_data;
+    }
+
+    [[nodiscard]]
+    ref<T> operator[](usize index) const {
+        return m_data[index];
+    }
+
+    [[nodiscard]]
+    ptr<T> begin() const {
+        return m_data;
+    }
+
+    [[nodiscard]]
+    ptr<T> end() const {
+        return m_data + m_len;
+    }
+};
+
+#endif //BUFFER_H
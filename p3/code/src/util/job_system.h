@@ -0,0 +1,333 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <util/trace.h>
+#include <util/types.h>
+
+/**
+ * Persistent worker threads that run the parallel parts of a frame. Every worker has its own queue, it takes the
+ * newest job from it and steals the oldest job of another queue once its own is empty. A job is a range of items,
+ * whoever runs it splits off halves for others to steal until a range is no bigger than the work's grain.
+ *
+ * Threads that are not workers share one queue and help run jobs while they wait, so with no workers
+ * everything runs on the calling thread.
+ */
+class JobSystem {
+public:
+    /**
+     * Something to do for a range of items, different parts of the range may run on different threads at once
+     */
+    class Work {
+    public:
+        // ranges with at most this many items are not split any further
+        usize grain{1};
+
+        virtual ~Work() = default;
+        virtual void run(usize begin, usize end) = 0;
+        /**
+         * Called after every range has run, the work may be destroyed once the last of its items are reported
+         */
+        virtual void finished(ref_mut<JobSystem> jobs, usize items) = 0;
+    };
+
+private:
+    struct Job {
+        ptr_mut<Work> work;
+        usize begin;
+        usize end;
+    };
+
+    struct Queue {
+        std::mutex mutex{};
+        std::deque<Job> jobs{};
+    };
+
+    static constexpr usize NO_QUEUE = std::numeric_limits<usize>::max();
+    static inline thread_local ptr<JobSystem> t_system = nullptr;
+    static inline thread_local usize t_queue = NO_QUEUE;
+
+    std::vector<Queue> m_queues;
+    std::vector<std::thread> m_workers{};
+    // jobs in any queue, workers only sleep while it is zero
+    std::atomic<usize> m_queued{0};
+    std::atomic<usize> m_sleeping{0};
+    std::atomic<bool> m_stopping{false};
+    std::mutex m_sleep_mutex{};
+    std::condition_variable m_wake{};
+
+    [[nodiscard]]
+    usize own_queue() const {
+        return t_system == this ? t_queue : m_queues.size() - 1;
+    }
+
+    void push(Job job) {
+        auto& queue = m_queues[own_queue()];
+        {
+            std::lock_guard lock{queue.mutex};
+            queue.jobs.push_back(job);
+        }
+        m_queued.fetch_add(1);
+        if (m_sleeping.load() > 0) {
+            // taking the lock makes sure a worker about to sleep has either seen the job or is already waiting
+            { std::lock_guard lock{m_sleep_mutex}; }
+            m_wake.notify_one();
+        }
+    }
+
+    bool try_pop(ref_mut<Job> job) {
+        const auto own = own_queue();
+        for (usize i = 0; i < m_queues.size(); i++) {
+            auto& queue = m_queues[(own + i) % m_queues.size()];
+            std::lock_guard lock{queue.mutex};
+            if (queue.jobs.empty()) continue;
+            if (i == 0) {
+                job = queue.jobs.back();
+                queue.jobs.pop_back();
+            } else {
+                job = queue.jobs.front();
+                queue.jobs.pop_front();
+            }
+            m_queued.fetch_sub(1);
+            return true;
+        }
+        return false;
+    }
+
+    void execute(Job job) {
+        while (job.end - job.begin > job.work->grain) {
+            const auto middle = job.begin + (job.end - job.begin) / 2;
+            push({job.work, middle, job.end});
+            job.end = middle;
+        }
+        job.work->run(job.begin, job.end);
+        job.work->finished(*this, job.end - job.begin);
+    }
+
+    void work(usize queue) {
+        t_system = this;
+        t_queue = queue;
+        TRACE_THREAD("job worker " + std::to_string(queue));
+        while (!m_stopping.load()) {
+            Job job{};
+            if (try_pop(job)) {
+                execute(job);
+                continue;
+            }
+            std::unique_lock lock{m_sleep_mutex};
+            m_sleeping.fetch_add(1);
+            m_wake.wait(lock, [this] { return m_stopping.load() || m_queued.load() > 0; });
+            m_sleeping.fetch_sub(1);
+        }
+    }
+
+    template<typename Body>
+    class ForWork final : public Work {
+        Body& m_body;
+
+    public:
+        std::atomic<usize> remaining;
+
+        ForWork(Body& body, usize items, usize grain) : m_body(body), remaining(items) {
+            this->grain = grain;
+        }
+
+        void run(usize begin, usize end) override {
+            m_body(begin, end);
+        }
+
+        void finished(ref_mut<JobSystem>, usize items) override {
+            remaining.fetch_sub(items, std::memory_order_acq_rel);
+        }
+    };
+
+public:
+    /**
+     * @param workers threads started besides the ones that submit work
+     */
+    explicit JobSystem(usize workers) : m_queues(workers + 1) {
+        for (usize i = 0; i < workers; i++) {
+            m_workers.emplace_back([this, i] { work(i); });
+        }
+    }
+
+    /**
+     * One worker for every hardware thread but the one rendering
+     */
+    JobSystem() : JobSystem(std::max(1u, std::thread::hardware_concurrency()) - 1) {}
+
+    JobSystem(ref<JobSystem>) = delete;
+    JobSystem& operator=(ref<JobSystem>) = delete;
+
+    ~JobSystem() {
+        {
+            std::lock_guard lock{m_sleep_mutex};
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        for (auto& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    /**
+     * @return how many threads can run jobs at once, counting the caller
+     */
+    [[nodiscard]]
+    usize threads() const {
+        return m_workers.size() + 1;
+    }
+
+    /**
+     * Queues the items begin to end of work, it is told through Work::finished as they complete
+     */
+    void submit(ref_mut<Work> work, usize begin, usize end) {
+        push({&work, begin, end});
+    }
+
+    /**
+     * Runs queued jobs on the calling thread until done returns true
+     */
+    template<typename Done>
+    void help_until(Done&& done) {
+        while (!done()) {
+            Job job{};
+            if (try_pop(job)) {
+                execute(job);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    /**
+     * Calls body(chunk_begin, chunk_end) for ranges of at most grain items covering begin to end, and returns once all have run
+     */
+    template<typename Body>
+    void parallel_for(usize begin, usize end, usize grain, Body&& body) {
+        if (begin >= end) return;
+        grain = std::max<usize>(grain, 1);
+        if (m_workers.empty() || end - begin <= grain) {
+            for (auto chunk = begin; chunk < end; chunk += grain) {
+                body(chunk, std::min(chunk + grain, end));
+            }
+            return;
+        }
+        ForWork<Body> work{body, end - begin, grain};
+        execute({&work, begin, end});
+        help_until([&] { return work.remaining.load(std::memory_order_acquire) == 0; });
+    }
+};
+
+/**
+ * Tasks and the order they have to run in. A task starts once every task it was added after has finished,
+ * tasks that do not depend on each other run at the same time.
+ */
+class TaskGraph {
+public:
+    using TaskId = usize;
+
+private:
+    class Task final : public JobSystem::Work {
+    public:
+        TaskGraph& graph;
+        std::function<void(usize, usize)> body;
+        usize count;
+        std::atomic<usize> remaining;
+        // tasks this one was added after which have not finished
+        std::atomic<usize> waiting{0};
+        std::vector<TaskId> dependents{};
+
+        Task(TaskGraph& graph, usize count, usize grain, std::function<void(usize, usize)>&& body) :
+            graph(graph), body(std::move(body)), count(count), remaining(count) {
+            this->grain = std::max<usize>(grain, 1);
+        }
+
+        void run(usize begin, usize end) override {
+            body(begin, end);
+        }
+
+        void finished(ref_mut<JobSystem> jobs, usize items) override {
+            if (remaining.fetch_sub(items, std::memory_order_acq_rel) == items) {
+                graph.complete(jobs, *this);
+            }
+        }
+    };
+
+    // a deque keeps tasks in place as more are added
+    std::deque<Task> m_tasks{};
+    std::atomic<usize> m_unfinished{0};
+
+    void start(ref_mut<JobSystem> jobs, ref_mut<Task> task) {
+        if (task.count == 0) {
+            complete(jobs, task);
+        } else {
+            jobs.submit(task, 0, task.count);
+        }
+    }
+
+    void complete(ref_mut<JobSystem> jobs, ref_mut<Task> task) {
+        for (const auto dependent : task.dependents) {
+            if (m_tasks[dependent].waiting.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                start(jobs, m_tasks[dependent]);
+            }
+        }
+        // the last access to the graph, run may return right after
+        m_unfinished.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+public:
+    TaskGraph() = default;
+    TaskGraph(ref<TaskGraph>) = delete;
+    TaskGraph& operator=(ref<TaskGraph>) = delete;
+
+    /**
+     * Adds a task calling body(chunk_begin, chunk_end) for ranges of at most grain of its count items
+     * @param after tasks that have to finish before this one starts
+     */
+    TaskId add_for(usize count, usize grain, std::function<void(usize, usize)> body, std::initializer_list<TaskId> after = {}) {
+        const auto id = m_tasks.size();
+        auto& task = m_tasks.emplace_back(*this, count, grain, std::move(body));
+        for (const auto dependency : after) {
+            m_tasks[dependency].dependents.push_back(id);
+        }
+        task.waiting = after.size();
+        return id;
+    }
+
+    /**
+     * Adds a task running body once
+     */
+    TaskId add(std::function<void()> body, std::initializer_list<TaskId> after = {}) {
+        return add_for(1, 1, [body = std::move(body)](usize, usize) { body(); }, after);
+    }
+
+    /**
+     * Runs every task, the calling thread helps until all have finished. A graph can only run once.
+     */
+    void run(ref_mut<JobSystem> jobs) {
+        m_unfinished = m_tasks.size();
+        // found before any task starts, a finished task may already have started its dependents
+        std::vector<ptr_mut<Task>> roots{};
+        for (auto& task : m_tasks) {
+            if (task.waiting.load() == 0) roots.push_back(&task);
+        }
+        for (auto* task : roots) {
+            start(jobs, *task);
+        }
+        jobs.help_until([this] { return m_unfinished.load(std::memory_order_acquire) == 0; });
+    }
+};
+
+#endif //JOB_SYSTEM_H
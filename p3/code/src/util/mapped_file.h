@@ -0,0 +1,101 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <optional>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <util/types.h>
+
+/**
+ * The size and modification time of a file, used to tell if a file derived from it is stale
+ */
+struct FileStamp {
+    u64 size{0};
+    i64 mtime{0};
+
+    [[nodiscard]]
+    static std::optional<FileStamp> of(ref<std::string> path) {
+        struct stat info{};
+        if (stat(path.c_str(), &info) != 0) return std::nullopt;
+        return FileStamp{
+            static_cast<u64>(info.st_size),
+            static_cast<i64>(info.st_mtim.tv_sec) * 1000000000 + static_cast<i64>(info.st_mtim.tv_nsec),
+        };
+    }
+
+    friend bool operator==(ref<FileStamp> lhs, ref<FileStamp> rhs) {
+        return lhs.size == rhs.size && lhs.mtime == rhs.mtime;
+    }
+
+    friend bool operator!=(ref<FileStamp> lhs, ref<FileStamp> rhs) {
+        return !(lhs == rhs);
+    }
+};
+
+/**
+ * A read only mapping of an entire file, the pages are only read from disk once they are touched
+ */
+class MappedFile {
+    ptr_mut<u8> m_data;
+    usize m_size;
+
+    MappedFile(ptr_mut<u8> data, usize size) : m_data(data), m_size(size) {}
+public:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept : m_data(other.m_data), m_size(other.m_size) {
+        other.m_data = nullptr;
+        other.m_size = 0;
+    }
+
+    [[nodiscard]]
+    static std::optional<MappedFile> open(ref<std::string> path) {
+        const auto fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return std::nullopt;
+
+        struct stat info{};
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            close(fd);
+            return std::nullopt;
+        }
+
+        const auto size = static_cast<usize>(info.st_size);
+        auto data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) return std::nullopt;
+
+        return MappedFile{static_cast<ptr_mut<u8>>(data), size};
+    }
+
+    [[nodiscard]]
+    ptr<u8> data() const {
+        return this->m_data;
+    }
+
+    [[nodiscard]]
+    usize size() const {
+        return this->m_size;
+    }
+
+    /**
+     * @return a pointer to a T at the byte offset or null if it does not fit inside the file
+     */
+    template<typename T>
+    [[nodiscard]]
+    ptr<T> at(usize offset, usize count = 1) const {
+        if (offset > m_size || count > (m_size - offset) / sizeof(T)) return nullptr;
+        return reinterpret_cast<ptr<T>>(m_data + offset);
+    }
+
+    ~MappedFile() {
+        if (this->m_data) munmap(this->m_data, this->m_size);
+    }
+};
+
+#endif //MAPPED_FILE_H
@@ -0,0 +1,223 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <util/trace.h>
+#include <util/types.h>
+
+/**
+ * Time spent in each stage of a frame. Zones add the time between their start and end to their stage, a stage split
+ * into jobs running on several threads at once reports the time of all its jobs together. Every end_frame takes
+ * the time each stage spent since the last one as a sample.
+ */
+class Profiler {
+public:
+    enum class Stage : usize {
+        Frame,
+        Update,
+        Clear,
+        RenderScene,
+        RenderLights,
+        Fragment,
+        WriteImage,
+        Count,
+    };
+
+    static constexpr usize STAGES = static_cast<usize>(Stage::Count);
+    static constexpr std::array<std::string_view, STAGES> NAMES{
+        "frame", "update", "clear", "render_scene", "render_lights", "fragment", "write_image",
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * Adds the time until it is destroyed to a stage, and to the trace when tracing
+     */
+    class Zone {
+        Profiler& m_profiler;
+        Stage m_stage;
+        Clock::time_point m_start;
+#ifdef USE_TRACE
+        Trace::Scope m_trace;
+#endif
+
+    public:
+        Zone(Profiler& profiler, Stage stage) : m_profiler(profiler), m_stage(stage), m_start(Clock::now())
+#ifdef USE_TRACE
+            , m_trace(NAMES[static_cast<usize>(stage)].data())
+#endif
+        {}
+
+        Zone(ref<Zone>) = delete;
+        Zone& operator=(ref<Zone>) = delete;
+
+        ~Zone() {
+            m_profiler.add(m_stage, std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_start).count());
+        }
+    };
+
+    struct Summary {
+        usize frames{0};
+        f64 mean{0};
+        f64 min{0};
+        f64 median{0};
+        f64 p95{0};
+        f64 p99{0};
+    };
+
+private:
+    struct Accumulator {
+        std::atomic<u64> nanoseconds{0};
+        std::atomic<u32> zones{0};
+    };
+
+    std::array<Accumulator, STAGES> m_current{};
+    // microseconds of every frame a stage ran in, -1 where it did not
+    std::vector<std::array<f64, STAGES>> m_frames{};
+
+    /**
+     * @param fraction of the samples at or below the result, by nearest rank
+     */
+    static f64 percentile(ref<std::vector<f64>> sorted, f64 fraction) {
+        const auto rank = static_cast<usize>(std::ceil(fraction * static_cast<f64>(sorted.size())));
+        return sorted[std::clamp<usize>(rank, 1, sorted.size()) - 1];
+    }
+
+public:
+    Profiler() = default;
+    Profiler(ref<Profiler>) = delete;
+    Profiler& operator=(ref<Profiler>) = delete;
+
+    [[nodiscard]]
+    Zone zone(Stage stage) {
+        return {*this, stage};
+    }
+
+    void add(Stage stage, u64 nanoseconds) {
+        auto& current = m_current[static_cast<usize>(stage)];
+        current.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+        current.zones.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Takes a sample of every stage, no zone may be running
+     */
+    void end_frame() {
+        auto& frame = m_frames.emplace_back();
+        for (usize stage = 0; stage < STAGES; stage++) {
+            const auto zones = m_current[stage].zones.exchange(0, std::memory_order_relaxed);
+            const auto nanoseconds = m_current[stage].nanoseconds.exchange(0, std::memory_order_relaxed);
+            frame[stage] = zones == 0 ? -1 : static_cast<f64>(nanoseconds) / 1000.;
+        }
+    }
+
+    [[nodiscard]]
+    usize frames() const {
+        return m_frames.size();
+    }
+
+    /**
+     * @return microseconds the stage took in the last frame, -1 if it did not run
+     */
+    [[nodiscard]]
+    f64 last(Stage stage) const {
+        return m_frames.empty() ? -1 : m_frames.back()[static_cast<usize>(stage)];
+    }
+
+    /**
+     * Statistics in microseconds over the frames the stage ran in
+     */
+    [[nodiscard]]
+    Summary summary(Stage stage) const {
+        std::vector<f64> samples{};
+        for (const auto& frame : m_frames) {
+            if (frame[static_cast<usize>(stage)] >= 0) samples.push_back(frame[static_cast<usize>(stage)]);
+        }
+        if (samples.empty()) return {};
+        std::sort(samples.begin(), samples.end());
+        f64 total = 0;
+        for (const auto sample : samples) total += sample;
+        return {
+            samples.size(),
+            total / static_cast<f64>(samples.size()),
+            samples.front(),
+            percentile(samples, 0.5),
+            percentile(samples, 0.95),
+            percentile(samples, 0.99),
+        };
+    }
+
+    void print(std::ostream& out) const {
+        out << std::left << std::setw(16) << "stage" << std::right;
+        for (const auto* column : {"frames", "mean us", "min us", "median us", "p95 us", "p99 us"}) {
+            out << std::setw(12) << column;
+        }
+        out << '\n' << std::fixed << std::setprecision(1);
+        for (usize stage = 0; stage < STAGES; stage++) {
+            const auto s = summary(static_cast<Stage>(stage));
+            if (s.frames == 0) continue;
+            out << std::left << std::setw(16) << NAMES[stage] << std::right << std::setw(12) << s.frames <<
+                std::setw(12) << s.mean << std::setw(12) << s.min << std::setw(12) << s.median <<
+                std::setw(12) << s.p95 << std::setw(12) << s.p99 << '\n';
+        }
+        out << std::defaultfloat << std::flush;
+    }
+
+    /**
+     * One row of microseconds per stage for every frame, empty where a stage did not run
+     * @return if the file was written
+     */
+    [[nodiscard]]
+    bool write_csv(ref<std::string> path) const {
+        std::ofstream out(path, std::ios::trunc);
+        out << "index";
+        for (const auto name : NAMES) out << ',' << name;
+        out << '\n';
+        for (usize i = 0; i < m_frames.size(); i++) {
+            out << i;
+            for (const auto sample : m_frames[i]) {
+                out << ',';
+                if (sample >= 0) out << sample;
+            }
+            out << '\n';
+        }
+        return static_cast<bool>(out);
+    }
+
+    /**
+     * The summary of every stage along with its samples, null for frames it did not run in
+     * @return if the file was written
+     */
+    [[nodiscard]]
+    bool write_json(ref<std::string> path) const {
+        std::ofstream out(path, std::ios::trunc);
+        out << "{\n  \"unit\": \"us\",\n  \"frames\": " << m_frames.size() << ",\n  \"stages\": {";
+        for (usize stage = 0; stage < STAGES; stage++) {
+            const auto s = summary(static_cast<Stage>(stage));
+            out << (stage == 0 ? "" : ",") << "\n    \"" << NAMES[stage] << "\": {" <<
+                "\"frames\": " << s.frames << ", \"mean\": " << s.mean << ", \"min\": " << s.min <<
+                ", \"median\": " << s.median << ", \"p95\": " << s.p95 << ", \"p99\": " << s.p99 << ", \"samples\": [";
+            for (usize i = 0; i < m_frames.size(); i++) {
+                const auto sample = m_frames[i][stage];
+                out << (i == 0 ? "" : ", ");
+                if (sample >= 0) out << sample; else out << "null";
+            }
+            out << "]}";
+        }
+        out << "\n  }\n}\n";
+        return static_cast<bool>(out);
+    }
+};
+
+#endif //PROFILER_H
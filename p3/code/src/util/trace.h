@@ -0,0 +1,173 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/**
+ * Optional recording of what every thread is doing over time, written as Chrome trace_event JSON which Perfetto
+ * and chrome://tracing open. It only exists when built with USE_TRACE, otherwise the macros expand to nothing.
+ *
+ * TRACE_SCOPE(name) records the time until the end of the enclosing scope, TRACE_SCOPE_ID(name, id) also records a
+ * number like a mesh or row. Names have to be string literals or otherwise live as long as the program.
+ * TRACE_THREAD(name) names the calling thread and TRACE_WRITE(path) writes everything recorded.
+ */
+
+#ifdef USE_TRACE
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <util/types.h>
+
+class Trace {
+public:
+    // events kept per thread, older ones are overwritten once a thread has recorded more
+    static constexpr usize CAPACITY = 1 << 16;
+    static constexpr u64 NO_ID = ~u64{0};
+
+    using Clock = std::chrono::steady_clock;
+
+private:
+    struct Event {
+        ptr<char> name;
+        u64 id;
+        // nanoseconds since the trace started
+        u64 start;
+        u64 duration;
+    };
+
+    /**
+     * Written only by its own thread, read once tracing is over
+     */
+    struct Buffer {
+        std::array<Event, CAPACITY> events{};
+        std::atomic<u64> written{0};
+        std::string name{};
+        usize thread{0};
+    };
+
+    Clock::time_point m_start{Clock::now()};
+    // only taken the first time a thread records, and when writing
+    std::mutex m_mutex{};
+    std::vector<std::unique_ptr<Buffer>> m_buffers{};
+
+    static inline thread_local ptr_mut<Buffer> t_buffer = nullptr;
+
+    ref_mut<Buffer> buffer() {
+        if (!t_buffer) {
+            std::lock_guard lock{m_mutex};
+            auto& buffer = m_buffers.emplace_back(std::make_unique<Buffer>());
+            buffer->thread = m_buffers.size();
+            t_buffer = buffer.get();
+        }
+        return *t_buffer;
+    }
+
+    static void write_string(std::ostream& out, ref<std::string> value) {
+        out << '"';
+        for (const auto c : value) {
+            if (c == '"' || c == '\\') out << '\\';
+            out << c;
+        }
+        out << '"';
+    }
+
+public:
+    static ref_mut<Trace> instance() {
+        static Trace trace{};
+        return trace;
+    }
+
+    [[nodiscard]]
+    u64 now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_start).count();
+    }
+
+    void record(ptr<char> name, u64 id, u64 start, u64 end) {
+        auto& buffer = this->buffer();
+        const auto index = buffer.written.load(std::memory_order_relaxed);
+        buffer.events[index % CAPACITY] = {name, id, start, end - start};
+        buffer.written.store(index + 1, std::memory_order_release);
+    }
+
+    void name_thread(std::string name) {
+        buffer().name = std::move(name);
+    }
+
+    /**
+     * Writes the events of every thread, threads should not be recording anymore
+     * @return if the file was written
+     */
+    bool write(ref<std::string> path) {
+        std::lock_guard lock{m_mutex};
+        std::ofstream out(path, std::ios::trunc);
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        bool first = true;
+        for (const auto& buffer : m_buffers) {
+            if (!buffer->name.empty()) {
+                out << (first ? "" : ",\n") << R"({"name": "thread_name", "ph": "M", "pid": 1, "tid": )" << buffer->thread << R"(, "args": {"name": )";
+                write_string(out, buffer->name);
+                out << "}}";
+                first = false;
+            }
+            const auto written = buffer->written.load(std::memory_order_acquire);
+            const auto kept = std::min<u64>(written, CAPACITY);
+            for (auto i = written - kept; i < written; i++) {
+                const auto& event = buffer->events[i % CAPACITY];
+                out << (first ? "" : ",\n") << R"({"name": )";
+                write_string(out, event.name);
+                out << R"(, "cat": "rasterizer", "ph": "X", "pid": 1, "tid": )" << buffer->thread <<
+                    R"(, "ts": )" << static_cast<f64>(event.start) / 1000. <<
+                    R"(, "dur": )" << static_cast<f64>(event.duration) / 1000.;
+                if (event.id != NO_ID) out << R"(, "args": {"id": )" << event.id << '}';
+                out << '}';
+                first = false;
+            }
+        }
+        out << "\n]}\n";
+        return static_cast<bool>(out);
+    }
+
+    /**
+     * Records the time from its creation to its destruction
+     */
+    class Scope {
+        ptr<char> m_name;
+        u64 m_id;
+        u64 m_start;
+
+    public:
+        explicit Scope(ptr<char> name, u64 id = NO_ID) : m_name(name), m_id(id), m_start(instance().now()) {}
+
+        Scope(ref<Scope>) = delete;
+        Scope& operator=(ref<Scope>) = delete;
+
+        ~Scope() {
+            auto& trace = instance();
+            trace.record(m_name, m_id, m_start, trace.now());
+        }
+    };
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) const Trace::Scope TRACE_CONCAT(trace_scope_, __LINE__){name}
+#define TRACE_SCOPE_ID(name, id) const Trace::Scope TRACE_CONCAT(trace_scope_, __LINE__){name, static_cast<u64>(id)}
+#define TRACE_THREAD(name) Trace::instance().name_thread(name)
+#define TRACE_WRITE(path) Trace::instance().write(path)
+
+#else
+
+#define TRACE_SCOPE(name) do {} while (false)
+#define TRACE_SCOPE_ID(name, id) do {} while (false)
+#define TRACE_THREAD(name) do {} while (false)
+#define TRACE_WRITE(path) true
+
+#endif
+
+#endif //TRACE_H
@@ -134,6 +134,16 @@ public:
     }
 
 
+    [[nodiscard]]
+    INLINE friend bool operator==(ref<Matrix> lhs, ref<Matrix> rhs) {
+        return lhs.data == rhs.data;
+    }
+
+    [[nodiscard]]
+    INLINE friend bool operator!=(ref<Matrix> lhs, ref<Matrix> rhs) {
+        return lhs.data != rhs.data;
+    }
+
     [[nodiscard]]
     INLINE friend Matrix operator/(ref<Matrix> lhs, T scaler) {
         Matrix result;